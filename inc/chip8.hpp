@@ -4,9 +4,13 @@
 #include <cstdint>
 #include <random>
 #include <chrono>
+#include <vector>
+#include <cstdio>
 
 #include "emulator_base.hpp"
 #include "chip8_utils.hpp"
+#include "rom_pack.hpp"
+#include "frame_pacer.hpp"
 
 struct Instruction{
     uint16_t opcode;  
@@ -14,6 +18,56 @@ struct Instruction{
     uint8_t Y;        // 4 bit register identifier
 };
 
+enum Fault : uint8_t {
+    FAULT_NONE = 0,
+    FAULT_UNKNOWN_OPCODE,
+    FAULT_STACK_OVERFLOW,
+    FAULT_STACK_UNDERFLOW,
+    FAULT_ROM_LOAD,
+};
+
+struct FaultInfo {
+    Fault code;
+    uint16_t pc;      // Address of the faulting instruction
+    uint16_t opcode;  // Faulting opcode
+};
+
+// Key event, applied at an instruction boundary of the next emulated frame
+struct InputEvent {
+    uint32_t timestamp;    // SDL ticks when the event arrived
+    uint32_t instruction;  // Instruction of the frame the event is applied before
+    uint8_t key;
+    bool pressed;
+};
+
+struct LatencyStats {
+    uint64_t events;
+    uint64_t total_ms;
+    uint32_t max_ms;
+};
+
+// Complete machine state, used to compare and rewind instances
+struct CHIP8Snapshot {
+    uint8_t registers[16];
+    uint8_t memory[MEMORY_SIZE];
+
+    uint16_t index_register;
+    uint16_t pc;
+    uint16_t stack[16];
+
+    uint8_t stack_pointer;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t input_keys[16];
+    bool beep;
+
+    uint32_t display[64 * 32];
+
+    std::default_random_engine rand_gen;
+
+    FaultInfo fault;
+};
+
 class CHIP8 : public EmulatorBase {
 private:
     EmulatorState m_emu_state;
@@ -29,27 +83,128 @@ private:
     uint8_t m_delay_timer;
     uint8_t m_sound_timer;
     uint8_t m_input_keys[16] = {};
+    bool m_beep;  // Sound timer expired, played once the frame is final
 
     uint32_t m_display[64 * 32] = {};
+    uint32_t m_presented_display[64 * 32] = {};
 
     Instruction m_inst = {};
 
+    FaultInfo m_fault = {};
+
     std::default_random_engine m_rand_gen;
     std::uniform_int_distribution<uint8_t> m_rand_byte;
 
+    RomPack m_rom_pack;
+    size_t m_rom_index = 0;
+    uint32_t m_faulted_roms = 0;  // ROMs that faulted during a headless pack walk
+
+    using InstructionHandler = void (CHIP8::*)();
+
+    // Lookup tables for the table dispatch engine, one set per quirk profile
+    template<QuirkProfile quirks>
+    struct DispatchTables {
+        InstructionHandler main[16];
+        InstructionHandler group_0[256];
+        InstructionHandler group_8[16];
+        InstructionHandler group_E[256];
+        InstructionHandler group_F[256];
+
+        DispatchTables();
+    };
+
+    template<QuirkProfile quirks>
+    static const DispatchTables<quirks> s_dispatch;
+
+    // Engines specialized for each quirk profile, indexed by [engine][quirks]
+    static const InstructionHandler s_engines[2][3];
+
+    // Engine selected by selectEngine() at construction and on each reset(). m_execute
+    // is the engine itself, or the instrumented wrapper when tracing or profiling
+    InstructionHandler m_engine;
+    InstructionHandler m_execute;
+
+    uint32_t m_instructions_per_frame;
+    QuirkProfile m_quirks;
+
+    // Tracing and profiling
+    FILE *m_trace_file = nullptr;
+    uint64_t m_frame_count = 0;
+    uint64_t m_instruction_count = 0;
+    uint64_t m_opcode_counts[16] = {};
+
+    // Key events polled since the last frame
+    std::vector<InputEvent> m_input_events;
+    uint32_t m_last_poll_time = 0;
+
+    LatencyStats m_latency = {};
+
+    FramePacer m_pacer;
+
+    // Run-ahead state
+    uint32_t m_run_ahead_frames;
+    CHIP8Snapshot m_frame_state;
+    CHIP8Snapshot m_speculative_state;
+    bool m_speculative_valid = false;
+    bool m_speculating = false;
+
 public:
     CHIP8(const EmulatorConfig&);
+    ~CHIP8();
+
+    // Returns false when the ROM, or any ROM of a headless pack walk, faulted
+    bool run();
+
+    // Reload the machine in place with another ROM, SDL is left untouched
+    bool reset(const RomImage&);
+
+    // Execute a single instruction with the configured engine and return the fault code.
+    // On a fault, fault() holds the PC and opcode and the PC is left on the faulting instruction.
+    // Faults are sticky: further calls execute nothing and return the same fault until reset()
+    Fault step();
+
+    const FaultInfo& fault() const;
+    static const char* faultName(Fault);
+
+    // Same names as the --quirks option
+    static const char* quirksName(QuirkProfile);
+
+    void setKey(uint8_t, bool);
+
+    // Emulate one frame, applying each event before its scheduled instruction
+    void runFrame(const std::vector<InputEvent>&);
+    void tickTimers();
+
+    uint32_t instructionsPerFrame() const;
 
-    void run();
+    void saveSnapshot(CHIP8Snapshot&) const;
+    void loadSnapshot(const CHIP8Snapshot&);
 
 private:
+    void resetState();
     bool loadROM(const char*);
+    bool findStartROM(const char*);
+    bool loadNextPackROM();
 
     void handleInput();
-    void emulateInstruction();
+    void scheduleInput(uint32_t);
+    void emulateFrames(uint32_t);
+    void commitFrame();
+    void presentFrame();
+    void reportLatency() const;
+    void runWindowed();
+    void runHeadless();
+    void writeProfile(double) const;
+
+    void selectEngine();
+    void raiseFault(Fault);
+    void fetchInstruction();
+    template<QuirkProfile quirks> void emulateInstruction();
+    template<QuirkProfile quirks> void emulateInstructionTable();
+    void emulateInstructionInstrumented();
     void updateScreen();
 
-    // CHIP8 instructions
+    // CHIP8 instructions, the quirk dependent ones are specialized per quirk profile
     void INSTR_00E0();
     void INSTR_00EE();
     void INSTR_1NNN();
@@ -60,17 +215,17 @@ private:
     void INSTR_6XNN();
     void INSTR_7XNN();
     void INSTR_8XY0();
-    void INSTR_8XY1();
-    void INSTR_8XY2();
-    void INSTR_8XY3();
+    template<QuirkProfile quirks> void INSTR_8XY1();
+    template<QuirkProfile quirks> void INSTR_8XY2();
+    template<QuirkProfile quirks> void INSTR_8XY3();
     void INSTR_8XY4();
     void INSTR_8XY5();
-    void INSTR_8XY6();
+    template<QuirkProfile quirks> void INSTR_8XY6();
     void INSTR_8XY7();
-    void INSTR_8XYE();
+    template<QuirkProfile quirks> void INSTR_8XYE();
     void INSTR_9XY0();
     void INSTR_ANNN();
-    void INSTR_BNNN();
+    template<QuirkProfile quirks> void INSTR_BNNN();
     void INSTR_CXNN();
     void INSTR_DXYN();
     void INSTR_EX9E();
@@ -82,8 +237,15 @@ private:
     void INSTR_FX1E();
     void INSTR_FX29();
     void INSTR_FX33();
-    void INSTR_FX55();
-    void INSTR_FX65();
+    template<QuirkProfile quirks> void INSTR_FX55();
+    template<QuirkProfile quirks> void INSTR_FX65();
+    void INSTR_UNKNOWN();
+
+    // Second level dispatch for the table engine
+    template<QuirkProfile quirks> void DISPATCH_0();
+    template<QuirkProfile quirks> void DISPATCH_8();
+    template<QuirkProfile quirks> void DISPATCH_E();
+    template<QuirkProfile quirks> void DISPATCH_F();
 };
 
 #endif // CHIP8_HPP
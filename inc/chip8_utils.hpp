@@ -2,8 +2,10 @@
 #define CHIP8_UTILS_HPP
 
 #include <cstdint>
+#include <cstddef>
 
 constexpr uint32_t MEMORY_SIZE = 4096;
+constexpr uint32_t MEMORY_MASK = MEMORY_SIZE - 1;
 constexpr uint32_t START_ADDRESS = 0x200;
 constexpr uint32_t FONTSET_SIZE = 80;
 constexpr uint32_t FONTSET_START_ADDRESS = 0x50;
@@ -27,4 +29,14 @@ const uint8_t fontset[FONTSET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// 64 bit FNV-1a hash, used to key ROM images by their content
+inline uint64_t fnv1a(const uint8_t *data, size_t size, uint64_t hash = 0xCBF29CE484222325ull) {
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
 #endif // CHIP8_UTILS_HPP
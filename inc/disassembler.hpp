@@ -0,0 +1,13 @@
+#ifndef DISASSEMBLER_HPP
+#define DISASSEMBLER_HPP
+
+#include <cstdint>
+#include <string>
+
+// Returns true if the opcode is implemented by the interpreter
+bool isValidOpcode(uint16_t);
+
+// Returns the opcode in assembly form, e.g. "DRW V1, V2, 5"
+std::string disassemble(uint16_t);
+
+#endif // DISASSEMBLER_HPP
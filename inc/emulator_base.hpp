@@ -11,9 +11,21 @@ enum EmulatorState {
     PAUSED,
 };
 
+enum ExecutionEngine {
+    ENGINE_SWITCH,  // Reference switch based interpreter
+    ENGINE_TABLE,   // Table dispatch interpreter
+};
+
+enum QuirkProfile : uint8_t {
+    QUIRKS_MODERN = 0,  // Shifts use VX, FX55/FX65 leave I, BNNN jumps to NNN + V0
+    QUIRKS_COSMAC_VIP,  // Shifts use VY, FX55/FX65 advance I, 8XY1/2/3 reset VF
+    QUIRKS_SCHIP,       // Shifts use VX, FX55/FX65 leave I, BXNN jumps to XNN + VX
+};
+
 struct SDLResources {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    uint32_t vsync_refresh_rate;  // Display refresh when presents wait for vsync, 0 otherwise
 };
 
 struct EmulatorConfig {
@@ -23,6 +35,18 @@ struct EmulatorConfig {
     uint32_t bg_color;        // Background color
     uint32_t scale_factor;    // Scaling the emulator screen
     const char *rom_name;     // ROM file name
+    bool headless;            // Run without creating an SDL window
+    uint32_t rng_seed;        // Random seed, 0 = seed from the clock
+    ExecutionEngine engine;   // Instruction execution engine
+    uint32_t instructions_per_frame;  // Instructions emulated per 60 Hz frame
+    uint32_t run_ahead_frames;        // Frames emulated ahead of input, 0 = disabled
+    bool unthrottled;                 // Run as fast as possible, without frame pacing
+    uint32_t turbo;                   // Emulated frames per paced frame
+    uint32_t max_frames;              // Stop after N emulated frames (per ROM in headless pack runs), 0 = run until quit
+    QuirkProfile quirks;              // Quirk profile, ROM pack metadata may override it
+    const char *profile_path;         // Write run statistics to this file, nullptr = disabled
+    const char *trace_path;           // Write an instruction trace to this file, nullptr = disabled
+    const char *start_rom;            // ROM pack entry to start with, by name or hash, nullptr = first
 };
 
 class EmulatorBase {
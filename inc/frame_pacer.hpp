@@ -0,0 +1,67 @@
+#ifndef FRAME_PACER_HPP
+#define FRAME_PACER_HPP
+
+#include <cstdint>
+
+struct FramePacingStats {
+    uint64_t presents;          // Paced loop iterations, presenting a frame unless headless
+    uint64_t frames;            // Emulated frames
+    uint64_t catch_up_frames;   // Extra frames emulated to catch up after running late
+    uint64_t skipped_frames;    // Frames dropped after a stall
+
+    // Present interval statistics in milliseconds, loop interval when headless
+    double interval_mean_ms;
+    double interval_m2;         // Sum of squared deviations, see stddev()
+    double interval_min_ms;
+    double interval_max_ms;
+    double jitter_max_ms;       // Largest deviation from the expected interval
+
+    double stddev() const;
+};
+
+/*
+    Paces emulation to exactly 60 emulated frames per second of host time.
+
+    Emulated time advances by one period per emulated frame. When the host falls
+    behind, up to max_catch_up frames are emulated per iteration to catch up, beyond
+    that the backlog is dropped and the clock resynchronized. Without vsync the
+    pacer sleeps coarsely and spin-waits the last fraction of every frame, with
+    vsync the present call blocks and the pacer only decides how many frames are due.
+*/
+class FramePacer {
+public:
+    FramePacer(uint32_t target_hz = 60, uint32_t max_catch_up = 4);
+
+    // refresh_rate is the display refresh when presents are synchronized to vsync, 0 otherwise.
+    // Headless loops present nothing, their intervals are reported as frame intervals
+    void start(uint32_t refresh_rate, bool presenting = true);
+    void resync();
+
+    // Number of emulated frames due this iteration
+    uint32_t beginFrame();
+
+    // Wait for the next frame deadline
+    void endFrame();
+
+    const FramePacingStats& stats() const;
+    void report() const;
+
+private:
+    uint64_t m_frequency;
+    uint64_t m_period;              // Emulated frame period in counter ticks
+    uint64_t m_present_period;      // Expected interval between presents
+    uint64_t m_spin_threshold;      // Busy-wait the last part of a frame
+    uint32_t m_max_catch_up;
+    bool m_vsync;
+    bool m_presenting;
+
+    uint64_t m_next_deadline;       // Host time the next emulated frame is due
+    uint64_t m_last_begin;
+
+    FramePacingStats m_stats;
+
+    uint64_t now() const;
+    void recordInterval(uint64_t);
+};
+
+#endif // FRAME_PACER_HPP
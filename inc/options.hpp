@@ -0,0 +1,53 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "emulator_base.hpp"
+#include "rom_pack.hpp"
+
+enum RunMode {
+    MODE_RUN,     // Run a ROM file or ROM pack
+    MODE_PACK,    // Build a ROM pack
+    MODE_VERIFY,  // Verify an engine against the reference engine
+    MODE_FUZZ,    // Fuzz an engine against the reference engine
+};
+
+/*
+    Runtime options, parsed once at startup.
+
+    Values are applied in order: defaults, then the config file (--config, or
+    <ROM file>.cfg when it exists), then the command line. emu_config points into
+    the strings owned by this struct, so Options must outlive it and is not copied.
+*/
+struct Options {
+    RunMode mode;
+    EmulatorConfig emu_config;
+
+    uint64_t verify_instructions;    // Instructions per ROM in verify mode
+    uint32_t check_interval;         // Compare states every N instructions in verify mode
+    uint32_t input_interval;         // Inject a key event every N instructions in verify mode
+    uint64_t fuzz_cases;             // Random instructions in fuzz mode
+
+    std::string rom_name;            // ROM file or ROM pack, pack file in pack mode
+    std::vector<std::string> pack_rom_names;    // ROM files in pack mode
+    std::vector<RomPackSource> pack_sources;    // ROM files and metadata, point into pack_rom_names
+
+    std::string config_path;
+    std::string profile_path;
+    std::string trace_path;
+    std::string start_rom;
+
+    Options();
+    Options(const Options&) = delete;
+    Options& operator=(const Options&) = delete;
+};
+
+// Returns false and prints the problem on invalid options
+bool parseOptions(int, char**, Options&);
+
+void printUsage(const char*);
+
+#endif // OPTIONS_HPP
@@ -0,0 +1,89 @@
+#ifndef ROM_PACK_HPP
+#define ROM_PACK_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+    ROM pack file layout (host byte order):
+
+    RomPackHeader
+    RomPackEntry[entry_count]   (in the order the ROMs were given)
+    uint32_t[entry_count]       (hash index, entry indices sorted by entry hash)
+    ROM images                  (referenced by entry offset/size)
+
+    Per-ROM metadata uses 0 for "use the emulator default". quirk_profile
+    otherwise stores the QuirkProfile + 1, so every profile can be forced,
+    QUIRKS_MODERN included.
+*/
+
+constexpr char ROM_PACK_MAGIC[4] = {'C', '8', 'P', 'K'};
+constexpr uint32_t ROM_PACK_VERSION = 2;
+constexpr uint32_t ROM_PACK_NAME_SIZE = 40;
+
+struct RomPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+};
+
+struct RomPackEntry {
+    uint64_t hash;                      // FNV-1a hash of the ROM image
+    uint32_t offset;                    // Offset of the ROM image from the start of the pack
+    uint16_t size;                      // ROM image size in bytes
+    uint16_t instructions_per_frame;    // 0 = use emulator default
+    uint8_t quirk_profile;              // 0 = use emulator default, else QuirkProfile + 1
+    uint8_t reserved[7];
+    char name[ROM_PACK_NAME_SIZE];      // Null terminated ROM file name
+};
+
+// Read-only view of a single ROM image and its metadata
+struct RomImage {
+    const uint8_t *data;
+    uint32_t size;
+    uint64_t hash;
+    uint16_t instructions_per_frame;
+    uint8_t quirk_profile;    // Encoded like RomPackEntry::quirk_profile
+    const char *name;
+};
+
+// ROM file and metadata used when building a pack
+struct RomPackSource {
+    const char *rom_name;
+    uint16_t instructions_per_frame;
+    uint8_t quirk_profile;    // Encoded like RomPackEntry::quirk_profile
+};
+
+class RomPack {
+public:
+    RomPack();
+    ~RomPack();
+
+    RomPack(const RomPack&) = delete;
+    RomPack& operator=(const RomPack&) = delete;
+
+    bool open(const char*);
+    void close();
+
+    size_t size() const;
+    RomImage at(size_t) const;
+
+    // Look up the index of an entry by content hash or file name
+    bool find(uint64_t, size_t&) const;
+    bool findByName(const char*, size_t&) const;
+
+    static bool isPackFile(const char*);
+    static bool build(const char*, const std::vector<RomPackSource>&);
+
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+
+    const RomPackHeader *m_header;
+    const RomPackEntry *m_entries;
+    const uint32_t *m_hash_index;
+};
+
+#endif // ROM_PACK_HPP
@@ -0,0 +1,57 @@
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+
+#include <cstdint>
+#include <string>
+#include <memory>
+
+#include "chip8.hpp"
+
+struct VerifierConfig {
+    ExecutionEngine reference;  // Engine treated as correct
+    ExecutionEngine candidate;  // Engine under test
+    uint64_t instructions;      // Instructions to run per ROM
+    uint32_t check_interval;    // Compare states every N instructions
+    uint32_t input_interval;    // Inject a key event every N instructions, 0 = no input
+    uint32_t instructions_per_frame;  // Timers tick every N instructions
+    uint32_t seed;              // Seed for the input stream, RNG and fuzzer
+    QuirkProfile quirks;        // Quirk profile shared by both engines
+};
+
+/*
+    Runs two execution engines in lockstep on the same ROM and input stream and
+    compares their full machine state every check_interval instructions. On a
+    mismatch both engines are rewound to the last matching state and replayed one
+    instruction at a time to report the first divergent instruction.
+*/
+class Verifier {
+public:
+    Verifier(const VerifierConfig&);
+
+    bool verifyROM(const RomImage&);
+    bool verifyFile(const char*);
+
+    // Execute random opcodes from random machine states on both engines
+    bool fuzz(uint64_t);
+
+private:
+    VerifierConfig m_config;
+
+    std::unique_ptr<CHIP8> m_reference;
+    std::unique_ptr<CHIP8> m_candidate;
+
+    // Last states both engines agreed on
+    CHIP8Snapshot m_reference_state;
+    CHIP8Snapshot m_candidate_state;
+
+    // States captured at the current check
+    CHIP8Snapshot m_reference_check;
+    CHIP8Snapshot m_candidate_check;
+
+    Fault stepEngines(uint64_t);
+    bool findDivergence(uint64_t, uint64_t);
+
+    static std::string compareStates(const CHIP8Snapshot&, const CHIP8Snapshot&);
+};
+
+#endif // VERIFIER_HPP
@@ -1,34 +1,277 @@
 #include "../inc/chip8.hpp"
+#include "../inc/disassembler.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <csignal>
+
+// Headless runs have no SDL event loop, SIGINT asks them to quit instead
+static volatile sig_atomic_t s_interrupted = 0;
+
+static void handleInterrupt(int) {
+    s_interrupted = 1;
+}
 
 CHIP8::CHIP8(const EmulatorConfig &emu_config) : EmulatorBase(emu_config) {
     std::cout << "Initializing CHIP-8...\n";
 
     m_emu_state = RUNNING;
 
-    m_pc = START_ADDRESS;
+    m_instructions_per_frame = std::max<uint32_t>(emu_config.instructions_per_frame, 1);
+    m_run_ahead_frames = emu_config.run_ahead_frames;
+    m_quirks = emu_config.quirks;
 
-    // Load font into memory
-    for(uint32_t i = 0; i < FONTSET_SIZE; ++i) {
-        m_memory[FONTSET_START_ADDRESS + i] = fontset[i];
+    resetState();
+
+    // Load ROM file, or the first ROM of a ROM pack.
+    // Without a ROM file the caller provides one through reset()
+    bool rom_loaded = true;
+
+    if(!emu_config.rom_name) {
+        std::cout << "No ROM file given, waiting for reset\n";
+    }
+    else if(RomPack::isPackFile(emu_config.rom_name)) {
+        rom_loaded = m_rom_pack.open(emu_config.rom_name) && m_rom_pack.size() > 0 &&
+                     findStartROM(emu_config.start_rom) && reset(m_rom_pack.at(m_rom_index));
     }
+    else {
+        if(emu_config.start_rom) {
+            std::cout << "Ignoring start ROM " << emu_config.start_rom << ", " << emu_config.rom_name
+                      << " is not a ROM pack\n";
+        }
 
-    // Load ROM file
-    if(!loadROM(emu_config.rom_name)) {
+        rom_loaded = loadROM(emu_config.rom_name);
+    }
+
+    if(!rom_loaded) {
         std::cerr << "Failed to load ROM!\n";
-        exit(EXIT_FAILURE); 
+        m_fault = {FAULT_ROM_LOAD, 0, 0};
     }
 
     // Setup random engine
-    m_rand_gen = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
+    if(emu_config.rng_seed != 0) {
+        m_rand_gen = std::default_random_engine(emu_config.rng_seed);
+    }
+    else {
+        m_rand_gen = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
+    }
     m_rand_byte = std::uniform_int_distribution<uint8_t>(0, 255);
 
+    if(emu_config.trace_path) {
+        m_trace_file = fopen(emu_config.trace_path, "w");
+
+        if(!m_trace_file) {
+            std::cerr << "ERROR: Failed to open trace file " << emu_config.trace_path << "!\n";
+        }
+    }
+
+    selectEngine();
+
     std::cout << "Succesfully initialized CHIP-8!\n";
 }
 
+CHIP8::~CHIP8() {
+    if(m_trace_file) {
+        fclose(m_trace_file);
+    }
+}
+
+void CHIP8::resetState() {
+    memset(m_registers, 0, sizeof(m_registers));
+    memset(m_memory, 0, sizeof(m_memory));
+    memset(m_stack, 0, sizeof(m_stack));
+    memset(m_input_keys, 0, sizeof(m_input_keys));
+    memset(m_display, 0, sizeof(m_display));
+
+    m_index_register = 0;
+    m_pc = START_ADDRESS;
+    m_stack_pointer = 0;
+    m_delay_timer = 0;
+    m_sound_timer = 0;
+    m_beep = false;
+    m_inst = {};
+    m_fault = {};
+
+    m_input_events.clear();
+    m_speculative_valid = false;
+
+    // Load font into memory
+    for(uint32_t i = 0; i < FONTSET_SIZE; ++i) {
+        m_memory[FONTSET_START_ADDRESS + i] = fontset[i];
+    }
+}
+
+bool CHIP8::reset(const RomImage &rom) {
+    const size_t max_size = sizeof(m_memory) - START_ADDRESS;
+
+    if(rom.size > max_size) {
+        std::cerr << "ERROR: Current ROM size(" << rom.size << 
+                      ") is greater than the maximum allowed size(" << max_size << ")!\n";
+        m_fault = {FAULT_ROM_LOAD, 0, 0};
+        return false;
+    }
+
+    resetState();
+    memcpy(&m_memory[START_ADDRESS], rom.data, rom.size);
+
+    // ROM metadata overrides the configured speed and quirks
+    m_instructions_per_frame = std::max<uint32_t>(rom.instructions_per_frame ? rom.instructions_per_frame
+                                                                             : m_emu_config.instructions_per_frame, 1);
+
+    // Pack quirk profiles are stored + 1, 0 keeps the configured profile
+    m_quirks = m_emu_config.quirks;
+    if(rom.quirk_profile > 0 && rom.quirk_profile - 1 <= QUIRKS_SCHIP) {
+        m_quirks = static_cast<QuirkProfile>(rom.quirk_profile - 1);
+    }
+
+    selectEngine();
+
+    return true;
+}
+
+Fault CHIP8::step() {
+    // A fault stays recorded until reset(), the machine does not run past it
+    if(m_fault.code != FAULT_NONE) {
+        return m_fault.code;
+    }
+
+    (this->*m_execute)();
+
+    return m_fault.code;
+}
+
+const FaultInfo& CHIP8::fault() const {
+    return m_fault;
+}
+
+const char* CHIP8::faultName(Fault fault) {
+    switch(fault) {
+        case FAULT_NONE:            return "none";
+        case FAULT_UNKNOWN_OPCODE:  return "unknown opcode";
+        case FAULT_STACK_OVERFLOW:  return "stack overflow";
+        case FAULT_STACK_UNDERFLOW: return "stack underflow";
+        case FAULT_ROM_LOAD:        return "ROM load failure";
+    }
+
+    return "unknown fault";
+}
+
+const char* CHIP8::quirksName(QuirkProfile quirks) {
+    switch(quirks) {
+        case QUIRKS_MODERN:     return "modern";
+        case QUIRKS_COSMAC_VIP: return "vip";
+        case QUIRKS_SCHIP:      return "schip";
+    }
+
+    return "unknown";
+}
+
+void CHIP8::setKey(uint8_t key, bool pressed) {
+    m_input_keys[key & 0xF] = pressed ? 1 : 0;
+}
+
+void CHIP8::runFrame(const std::vector<InputEvent> &events) {
+    size_t next_event = 0;
+
+    for(uint32_t i = 0; i < m_instructions_per_frame; ++i) {
+        // Apply key events scheduled before this instruction
+        while(next_event < events.size() && events[next_event].instruction <= i) {
+            setKey(events[next_event].key, events[next_event].pressed);
+            ++next_event;
+        }
+
+        if(step() != FAULT_NONE) {
+            return;
+        }
+    }
+
+    for(; next_event < events.size(); ++next_event) {
+        setKey(events[next_event].key, events[next_event].pressed);
+    }
+
+    tickTimers();
+
+    if(!m_speculating) {
+        commitFrame();
+    }
+}
+
+uint32_t CHIP8::instructionsPerFrame() const {
+    return m_instructions_per_frame;
+}
+
+void CHIP8::saveSnapshot(CHIP8Snapshot &snapshot) const {
+    memcpy(snapshot.registers, m_registers, sizeof(m_registers));
+    memcpy(snapshot.memory, m_memory, sizeof(m_memory));
+    memcpy(snapshot.stack, m_stack, sizeof(m_stack));
+    memcpy(snapshot.input_keys, m_input_keys, sizeof(m_input_keys));
+    memcpy(snapshot.display, m_display, sizeof(m_display));
+
+    snapshot.index_register = m_index_register;
+    snapshot.pc = m_pc;
+    snapshot.stack_pointer = m_stack_pointer;
+    snapshot.delay_timer = m_delay_timer;
+    snapshot.sound_timer = m_sound_timer;
+    snapshot.beep = m_beep;
+    snapshot.rand_gen = m_rand_gen;
+    snapshot.fault = m_fault;
+}
+
+void CHIP8::loadSnapshot(const CHIP8Snapshot &snapshot) {
+    memcpy(m_registers, snapshot.registers, sizeof(m_registers));
+    memcpy(m_memory, snapshot.memory, sizeof(m_memory));
+    memcpy(m_stack, snapshot.stack, sizeof(m_stack));
+    memcpy(m_input_keys, snapshot.input_keys, sizeof(m_input_keys));
+    memcpy(m_display, snapshot.display, sizeof(m_display));
+
+    m_index_register = snapshot.index_register;
+    m_pc = snapshot.pc;
+    m_stack_pointer = snapshot.stack_pointer;
+    m_delay_timer = snapshot.delay_timer;
+    m_sound_timer = snapshot.sound_timer;
+    m_beep = snapshot.beep;
+    m_rand_gen = snapshot.rand_gen;
+    m_fault = snapshot.fault;
+}
+
+// Pack entry to start with, by file name or by FNV-1a hash as 16 hex digits
+bool CHIP8::findStartROM(const char *start_rom) {
+    m_rom_index = 0;
+
+    bool found = !start_rom || m_rom_pack.findByName(start_rom, m_rom_index);
+
+    if(!found && strlen(start_rom) == 16 && strspn(start_rom, "0123456789abcdefABCDEF") == 16) {
+        found = m_rom_pack.find(strtoull(start_rom, nullptr, 16), m_rom_index);
+    }
+
+    if(!found) {
+        std::cerr << "ERROR: ROM pack has no ROM named or hashed " << start_rom << "!\n";
+        return false;
+    }
+
+    std::cout << "Starting with ROM " << m_rom_pack.at(m_rom_index).name << "\n";
+    return true;
+}
+
+bool CHIP8::loadNextPackROM() {
+    if(m_rom_pack.size() == 0) {
+        return false;
+    }
+
+    m_rom_index = (m_rom_index + 1) % m_rom_pack.size();
+
+    const RomImage rom = m_rom_pack.at(m_rom_index);
+    if(!reset(rom)) {
+        return false;
+    }
+
+    std::cout << "Switched to ROM " << rom.name << "\n";
+    return true;
+}
+
 bool CHIP8::loadROM(const char *rom_name) {
     std::cout << "Loading ROM " << rom_name << "...\n";
 
@@ -48,11 +291,13 @@ bool CHIP8::loadROM(const char *rom_name) {
     if(rom_size > max_size) {
         std::cerr << "ERROR: Current ROM file size(" << rom_size << 
                       ") is greater than the maximum allowed size(" << max_size << ")!\n";
+        fclose(rom);
         return false;
     }
 
     if(fread(&m_memory[START_ADDRESS], rom_size, 1, rom) != 1) {
         std::cerr << "ERROR: Could no read ROM file into emulated memory\n";
+        fclose(rom);
         return false;
     }
 
@@ -63,6 +308,39 @@ bool CHIP8::loadROM(const char *rom_name) {
     return true;
 }
 
+// Maps a host key to a CHIP8 key, -1 if the key is not mapped
+static int mapKey(SDL_Keycode keycode) {
+    /*
+        Keyboard mapping:
+
+        (original)     (emulator)
+        1 2 3 C   ->   1 2 3 4
+        4 5 6 D   ->   Q W E R
+        7 8 9 E   ->   A S D F
+        A 0 B F   ->   Z X C V
+    */
+    switch(keycode)
+    {
+    case SDLK_1:    return 0x1;
+    case SDLK_2:    return 0x2;
+    case SDLK_3:    return 0x3;
+    case SDLK_4:    return 0xC;
+    case SDLK_q:    return 0x4;
+    case SDLK_w:    return 0x5;
+    case SDLK_e:    return 0x6;
+    case SDLK_r:    return 0xD;
+    case SDLK_a:    return 0x7;
+    case SDLK_s:    return 0x8;
+    case SDLK_d:    return 0x9;
+    case SDLK_f:    return 0xE;
+    case SDLK_z:    return 0xA;
+    case SDLK_x:    return 0x0;
+    case SDLK_c:    return 0xB;
+    case SDLK_v:    return 0xF;
+    default:        return -1;
+    }
+}
+
 void CHIP8::handleInput() {
     SDL_Event event;
 
@@ -89,61 +367,39 @@ void CHIP8::handleInput() {
                     std::cout << "Emulator paused\n";
                 }
                 break;
-
-            /*
-                Keyboard mapping:
-
-                (original)     (emulator)
-                1 2 3 C   ->   1 2 3 4
-                4 5 6 D   ->   Q W E R
-                7 8 9 E   ->   A S D F
-                A 0 B F   ->   Z X C V
-            */
-
-            // Set key state to 1 if key pressed
-            case SDLK_1:    m_input_keys[0x1] = 1; break;
-            case SDLK_2:    m_input_keys[0x2] = 1; break;
-            case SDLK_3:    m_input_keys[0x3] = 1; break;
-            case SDLK_4:    m_input_keys[0xC] = 1; break;
-            case SDLK_q:    m_input_keys[0x4] = 1; break;
-            case SDLK_w:    m_input_keys[0x5] = 1; break;
-            case SDLK_e:    m_input_keys[0x6] = 1; break;
-            case SDLK_r:    m_input_keys[0xD] = 1; break;
-            case SDLK_a:    m_input_keys[0x7] = 1; break;
-            case SDLK_s:    m_input_keys[0x8] = 1; break;
-            case SDLK_d:    m_input_keys[0x9] = 1; break;
-            case SDLK_f:    m_input_keys[0xE] = 1; break;
-            case SDLK_z:    m_input_keys[0xA] = 1; break;
-            case SDLK_x:    m_input_keys[0x0] = 1; break;
-            case SDLK_c:    m_input_keys[0xB] = 1; break;
-            case SDLK_v:    m_input_keys[0xF] = 1; break;
+            case SDLK_TAB:      // Switch to the next ROM when running a ROM pack
+                loadNextPackROM();
+                break;
             }
-            break;
+            [[fallthrough]];
 
-        case SDL_KEYUP:
-            switch(event.key.keysym.sym)
-            {
-            // Set key state to 0 if key released
-            case SDLK_1:    m_input_keys[0x1] = 0; break;
-            case SDLK_2:    m_input_keys[0x2] = 0; break;
-            case SDLK_3:    m_input_keys[0x3] = 0; break;
-            case SDLK_4:    m_input_keys[0xC] = 0; break;
-            case SDLK_q:    m_input_keys[0x4] = 0; break;
-            case SDLK_w:    m_input_keys[0x5] = 0; break;
-            case SDLK_e:    m_input_keys[0x6] = 0; break;
-            case SDLK_r:    m_input_keys[0xD] = 0; break;
-            case SDLK_a:    m_input_keys[0x7] = 0; break;
-            case SDLK_s:    m_input_keys[0x8] = 0; break;
-            case SDLK_d:    m_input_keys[0x9] = 0; break;
-            case SDLK_f:    m_input_keys[0xE] = 0; break;
-            case SDLK_z:    m_input_keys[0xA] = 0; break;
-            case SDLK_x:    m_input_keys[0x0] = 0; break;
-            case SDLK_c:    m_input_keys[0xB] = 0; break;
-            case SDLK_v:    m_input_keys[0xF] = 0; break;
+        case SDL_KEYUP: {
+            // Queue key state changes, they are applied inside the next emulated frame
+            const int key = mapKey(event.key.keysym.sym);
+
+            if(key >= 0 && !event.key.repeat) {
+                m_input_events.push_back({event.key.timestamp, 0, static_cast<uint8_t>(key),
+                                          event.type == SDL_KEYDOWN});
             }
             break;
         }
+        }
+    }
+}
+
+void CHIP8::scheduleInput(uint32_t poll_time) {
+    // Events arrived while the previous frame was shown, replay them at the same
+    // relative position within the next frame
+    const uint64_t interval = poll_time - m_last_poll_time;
+
+    for(InputEvent &event : m_input_events) {
+        const uint64_t offset = event.timestamp > m_last_poll_time ? event.timestamp - m_last_poll_time : 0;
+
+        event.instruction = interval ? std::min<uint64_t>(offset * m_instructions_per_frame / interval,
+                                                          m_instructions_per_frame - 1) : 0;
     }
+
+    m_last_poll_time = poll_time;
 }
 
 void CHIP8::INSTR_00E0() {
@@ -152,8 +408,8 @@ void CHIP8::INSTR_00E0() {
 
 void CHIP8::INSTR_00EE() {
     if(m_stack_pointer == 0) {
-        std::cerr << "ERROR: Stack underflow!\n";
-        exit(EXIT_FAILURE);
+        raiseFault(FAULT_STACK_UNDERFLOW);
+        return;
     }
 
     --m_stack_pointer;
@@ -168,8 +424,8 @@ void CHIP8::INSTR_1NNN() {
 
 void CHIP8::INSTR_2NNN() {
     if(m_stack_pointer == 16) {
-        std::cerr << "ERROR: Stack overflow!\n";
-        exit(EXIT_FAILURE);
+        raiseFault(FAULT_STACK_OVERFLOW);
+        return;
     }
 
     m_stack[m_stack_pointer] = m_pc;
@@ -209,16 +465,31 @@ void CHIP8::INSTR_8XY0() {
     m_registers[m_inst.X] = m_registers[m_inst.Y];
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_8XY1() {
     m_registers[m_inst.X] |= m_registers[m_inst.Y];
+
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_registers[0xF] = 0;
+    }
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_8XY2() {
     m_registers[m_inst.X] &= m_registers[m_inst.Y];
+
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_registers[0xF] = 0;
+    }
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_8XY3() {
     m_registers[m_inst.X] ^= m_registers[m_inst.Y];
+
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_registers[0xF] = 0;
+    }
 }
 
 void CHIP8::INSTR_8XY4() {
@@ -243,7 +514,13 @@ void CHIP8::INSTR_8XY5() {
     m_registers[m_inst.X] -= m_registers[m_inst.Y];
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_8XY6() {
+    // The COSMAC VIP shifts VY into VX
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_registers[m_inst.X] = m_registers[m_inst.Y];
+    }
+
     m_registers[0xF] = m_registers[m_inst.X] & 0x1;
     m_registers[m_inst.X] >>= 1;
 }
@@ -259,7 +536,12 @@ void CHIP8::INSTR_8XY7() {
     m_registers[m_inst.X] = m_registers[m_inst.Y] - m_registers[m_inst.X];
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_8XYE() {
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_registers[m_inst.X] = m_registers[m_inst.Y];
+    }
+
     m_registers[0xF] = (m_registers[m_inst.X] & 0x80) >> 7;
     m_registers[m_inst.X] <<= 1;
 }
@@ -274,8 +556,12 @@ void CHIP8::INSTR_ANNN() {
     m_index_register = m_inst.opcode & 0x0FFF;
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_BNNN() {
-    m_pc = (m_inst.opcode & 0x0FFF) + m_registers[0x0];
+    // SCHIP reads the offset from VX (BXNN)
+    const uint8_t offset_register = quirks == QUIRKS_SCHIP ? m_inst.X : 0x0;
+
+    m_pc = (m_inst.opcode & 0x0FFF) + m_registers[offset_register];
 }
 
 void CHIP8::INSTR_CXNN() {
@@ -293,10 +579,11 @@ void CHIP8::INSTR_DXYN() {
     uint8_t x = m_registers[m_inst.X] % 64;
     uint8_t y = m_registers[m_inst.Y] % 32;
 
-    for(uint32_t row = 0; row < height; ++row) {
-        uint8_t spriteByte = m_memory[m_index_register + row];
+    // Sprites are clipped at the screen edges
+    for(uint32_t row = 0; row < height && y + row < 32; ++row) {
+        uint8_t spriteByte = m_memory[(m_index_register + row) & MEMORY_MASK];
 
-        for(uint32_t col = 0; col < width; ++col) {
+        for(uint32_t col = 0; col < width && x + col < 64; ++col) {
             uint8_t spritePixel = spriteByte & (0x80 >> col);
             uint32_t screenIndex = (y + row) * 64 + (x + col);
 
@@ -314,7 +601,7 @@ void CHIP8::INSTR_DXYN() {
 
 
 void CHIP8::INSTR_EX9E() {
-    uint8_t key = m_registers[m_inst.X];
+    uint8_t key = m_registers[m_inst.X] & 0xF;
 
     if(m_input_keys[key]) {
         m_pc += 2;
@@ -322,7 +609,7 @@ void CHIP8::INSTR_EX9E() {
 }
 
 void CHIP8::INSTR_EXA1() {
-    uint8_t key = m_registers[m_inst.X];
+    uint8_t key = m_registers[m_inst.X] & 0xF;
 
     if(!m_input_keys[key]) {
         m_pc += 2;
@@ -373,30 +660,73 @@ void CHIP8::INSTR_FX29() {
 void CHIP8::INSTR_FX33() {
     uint8_t val = m_registers[m_inst.X];
 
-    m_memory[m_index_register + 2] = val % 10;
+    m_memory[(m_index_register + 2) & MEMORY_MASK] = val % 10;
     val /= 10;
 
-    m_memory[m_index_register + 1] = val % 10;
+    m_memory[(m_index_register + 1) & MEMORY_MASK] = val % 10;
     val /= 10;
 
-    m_memory[m_index_register] = val % 10;
+    m_memory[m_index_register & MEMORY_MASK] = val % 10;
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_FX55() {
     for(uint8_t i = 0; i <= m_inst.X; ++i) {
-        m_memory[m_index_register + i] = m_registers[i];
+        m_memory[(m_index_register + i) & MEMORY_MASK] = m_registers[i];
+    }
+
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_index_register += m_inst.X + 1;
     }
 }
 
+template<QuirkProfile quirks>
 void CHIP8::INSTR_FX65() {
     for(uint8_t i = 0; i <= m_inst.X; ++i) {
-        m_registers[i] = m_memory[m_index_register + i];
+        m_registers[i] = m_memory[(m_index_register + i) & MEMORY_MASK];
+    }
+
+    if constexpr(quirks == QUIRKS_COSMAC_VIP) {
+        m_index_register += m_inst.X + 1;
     }
 }
 
-void CHIP8::emulateInstruction() {
+void CHIP8::INSTR_UNKNOWN() {
+    raiseFault(FAULT_UNKNOWN_OPCODE);
+}
+
+const CHIP8::InstructionHandler CHIP8::s_engines[2][3] = {
+    // ENGINE_SWITCH
+    {
+        &CHIP8::emulateInstruction<QUIRKS_MODERN>,
+        &CHIP8::emulateInstruction<QUIRKS_COSMAC_VIP>,
+        &CHIP8::emulateInstruction<QUIRKS_SCHIP>,
+    },
+    // ENGINE_TABLE
+    {
+        &CHIP8::emulateInstructionTable<QUIRKS_MODERN>,
+        &CHIP8::emulateInstructionTable<QUIRKS_COSMAC_VIP>,
+        &CHIP8::emulateInstructionTable<QUIRKS_SCHIP>,
+    },
+};
+
+// Quirks are resolved at compile time, so switching profiles swaps the engine instead.
+// Instrumentation only costs when enabled
+void CHIP8::selectEngine() {
+    m_engine = s_engines[m_emu_config.engine][m_quirks];
+    m_execute = (m_trace_file || m_emu_config.profile_path) ? &CHIP8::emulateInstructionInstrumented : m_engine;
+}
+
+void CHIP8::raiseFault(Fault fault) {
+    // Rewind to the faulting instruction, the machine stays stopped on it
+    m_pc -= 2;
+
+    m_fault = {fault, static_cast<uint16_t>(m_pc & MEMORY_MASK), m_inst.opcode};
+}
+
+void CHIP8::fetchInstruction() {
     // Get next opcode from memory
-    m_inst.opcode = (m_memory[m_pc] << 8) | m_memory[m_pc + 1];
+    m_inst.opcode = (m_memory[m_pc & MEMORY_MASK] << 8) | m_memory[(m_pc + 1) & MEMORY_MASK];
 
     // Fill instruction format
     m_inst.X = (m_inst.opcode & 0x0F00) >> 8;
@@ -404,6 +734,26 @@ void CHIP8::emulateInstruction() {
 
     // Pre-increment PC for next opcode
     m_pc += 2;
+}
+
+void CHIP8::tickTimers() {
+    if(m_delay_timer > 0) {
+        --m_delay_timer;
+    }
+
+    if(m_sound_timer > 0) {
+        // Run-ahead frames may be rewound, so the beep waits for commitFrame()
+        if(m_sound_timer == 1) {
+            m_beep = true;
+        }
+
+        --m_sound_timer;
+    }
+}
+
+template<QuirkProfile quirks>
+void CHIP8::emulateInstruction() {
+    fetchInstruction();
 
     // Emulate opcode
     switch(m_inst.opcode & 0xF000u) {
@@ -411,9 +761,7 @@ void CHIP8::emulateInstruction() {
             switch(m_inst.opcode & 0x00FFu) {
                 case 0x00E0: INSTR_00E0(); break;
                 case 0x00EE: INSTR_00EE(); break;
-                default:
-                    std::cerr << "Unsupported opcode: " << m_inst.opcode << "\n";
-                    exit(EXIT_FAILURE);
+                default:     INSTR_UNKNOWN(); break;
             }
             break;
         case 0x1000: INSTR_1NNN(); break;
@@ -426,31 +774,27 @@ void CHIP8::emulateInstruction() {
         case 0x8000:
             switch(m_inst.opcode & 0x000Fu) {
                 case 0x0000: INSTR_8XY0(); break;
-                case 0x0001: INSTR_8XY1(); break;
-                case 0x0002: INSTR_8XY2(); break;
-                case 0x0003: INSTR_8XY3(); break;
+                case 0x0001: INSTR_8XY1<quirks>(); break;
+                case 0x0002: INSTR_8XY2<quirks>(); break;
+                case 0x0003: INSTR_8XY3<quirks>(); break;
                 case 0x0004: INSTR_8XY4(); break;
                 case 0x0005: INSTR_8XY5(); break;
-                case 0x0006: INSTR_8XY6(); break;
+                case 0x0006: INSTR_8XY6<quirks>(); break;
                 case 0x0007: INSTR_8XY7(); break;
-                case 0x000E: INSTR_8XYE(); break;
-                default:
-                    std::cerr << "Unsupported opcode: " << m_inst.opcode << "\n";
-                    exit(EXIT_FAILURE);
+                case 0x000E: INSTR_8XYE<quirks>(); break;
+                default:     INSTR_UNKNOWN(); break;
             }
             break;
         case 0x9000: INSTR_9XY0(); break;
         case 0xA000: INSTR_ANNN(); break;
-        case 0xB000: INSTR_BNNN(); break;
+        case 0xB000: INSTR_BNNN<quirks>(); break;
         case 0xC000: INSTR_CXNN(); break;
         case 0xD000: INSTR_DXYN(); break;
         case 0xE000:
             switch(m_inst.opcode & 0x00FFu) {
                 case 0x009E: INSTR_EX9E(); break;
                 case 0x00A1: INSTR_EXA1(); break;
-                default:
-                    std::cerr << "Unsupported opcode: " << m_inst.opcode << "\n";
-                    exit(EXIT_FAILURE);
+                default:     INSTR_UNKNOWN(); break;
             }
             break;
         case 0xF000:
@@ -462,31 +806,123 @@ void CHIP8::emulateInstruction() {
                 case 0x001E: INSTR_FX1E(); break;
                 case 0x0029: INSTR_FX29(); break;
                 case 0x0033: INSTR_FX33(); break;
-                case 0x0055: INSTR_FX55(); break;
-                case 0x0065: INSTR_FX65(); break;
-                default:
-                    std::cerr << "Unsupported opcode: " << m_inst.opcode << "\n";
-                    exit(EXIT_FAILURE);
+                case 0x0055: INSTR_FX55<quirks>(); break;
+                case 0x0065: INSTR_FX65<quirks>(); break;
+                default:     INSTR_UNKNOWN(); break;
             }
             break;
-        default:
-            std::cerr << "Unsupported opcode: " << m_inst.opcode << "\n";
-            exit(EXIT_FAILURE);
+        default:     INSTR_UNKNOWN(); break;
     }
+}
 
-    // Update timers
+/*
+    Table dispatch engine.
+
+    Decodes exactly like the switch in emulateInstruction(): the top nibble selects
+    a handler, groups 0/E/F are keyed by the low byte and group 8 by the low nibble.
+    Every slot without an instruction maps to INSTR_UNKNOWN. Each quirk profile
+    has its own tables, pointing at the handlers specialized for it.
+*/
+template<QuirkProfile quirks>
+const CHIP8::DispatchTables<quirks> CHIP8::s_dispatch;
+
+template<QuirkProfile quirks>
+CHIP8::DispatchTables<quirks>::DispatchTables() {
+    for(InstructionHandler &handler : group_0) handler = &CHIP8::INSTR_UNKNOWN;
+    for(InstructionHandler &handler : group_8) handler = &CHIP8::INSTR_UNKNOWN;
+    for(InstructionHandler &handler : group_E) handler = &CHIP8::INSTR_UNKNOWN;
+    for(InstructionHandler &handler : group_F) handler = &CHIP8::INSTR_UNKNOWN;
+
+    main[0x0] = &CHIP8::DISPATCH_0<quirks>;
+    main[0x1] = &CHIP8::INSTR_1NNN;
+    main[0x2] = &CHIP8::INSTR_2NNN;
+    main[0x3] = &CHIP8::INSTR_3XNN;
+    main[0x4] = &CHIP8::INSTR_4XNN;
+    main[0x5] = &CHIP8::INSTR_5XY0;
+    main[0x6] = &CHIP8::INSTR_6XNN;
+    main[0x7] = &CHIP8::INSTR_7XNN;
+    main[0x8] = &CHIP8::DISPATCH_8<quirks>;
+    main[0x9] = &CHIP8::INSTR_9XY0;
+    main[0xA] = &CHIP8::INSTR_ANNN;
+    main[0xB] = &CHIP8::INSTR_BNNN<quirks>;
+    main[0xC] = &CHIP8::INSTR_CXNN;
+    main[0xD] = &CHIP8::INSTR_DXYN;
+    main[0xE] = &CHIP8::DISPATCH_E<quirks>;
+    main[0xF] = &CHIP8::DISPATCH_F<quirks>;
+
+    group_0[0xE0] = &CHIP8::INSTR_00E0;
+    group_0[0xEE] = &CHIP8::INSTR_00EE;
+
+    group_8[0x0] = &CHIP8::INSTR_8XY0;
+    group_8[0x1] = &CHIP8::INSTR_8XY1<quirks>;
+    group_8[0x2] = &CHIP8::INSTR_8XY2<quirks>;
+    group_8[0x3] = &CHIP8::INSTR_8XY3<quirks>;
+    group_8[0x4] = &CHIP8::INSTR_8XY4;
+    group_8[0x5] = &CHIP8::INSTR_8XY5;
+    group_8[0x6] = &CHIP8::INSTR_8XY6<quirks>;
+    group_8[0x7] = &CHIP8::INSTR_8XY7;
+    group_8[0xE] = &CHIP8::INSTR_8XYE<quirks>;
+
+    group_E[0x9E] = &CHIP8::INSTR_EX9E;
+    group_E[0xA1] = &CHIP8::INSTR_EXA1;
+
+    group_F[0x07] = &CHIP8::INSTR_FX07;
+    group_F[0x0A] = &CHIP8::INSTR_FX0A;
+    group_F[0x15] = &CHIP8::INSTR_FX15;
+    group_F[0x18] = &CHIP8::INSTR_FX18;
+    group_F[0x1E] = &CHIP8::INSTR_FX1E;
+    group_F[0x29] = &CHIP8::INSTR_FX29;
+    group_F[0x33] = &CHIP8::INSTR_FX33;
+    group_F[0x55] = &CHIP8::INSTR_FX55<quirks>;
+    group_F[0x65] = &CHIP8::INSTR_FX65<quirks>;
+}
 
-    if(m_delay_timer > 0) {
-        --m_delay_timer;
+template<QuirkProfile quirks>
+void CHIP8::DISPATCH_0() {
+    (this->*s_dispatch<quirks>.group_0[m_inst.opcode & 0x00FFu])();
+}
+
+template<QuirkProfile quirks>
+void CHIP8::DISPATCH_8() {
+    (this->*s_dispatch<quirks>.group_8[m_inst.opcode & 0x000Fu])();
+}
+
+template<QuirkProfile quirks>
+void CHIP8::DISPATCH_E() {
+    (this->*s_dispatch<quirks>.group_E[m_inst.opcode & 0x00FFu])();
+}
+
+template<QuirkProfile quirks>
+void CHIP8::DISPATCH_F() {
+    (this->*s_dispatch<quirks>.group_F[m_inst.opcode & 0x00FFu])();
+}
+
+template<QuirkProfile quirks>
+void CHIP8::emulateInstructionTable() {
+    fetchInstruction();
+
+    (this->*s_dispatch<quirks>.main[m_inst.opcode >> 12])();
+}
+
+void CHIP8::emulateInstructionInstrumented() {
+    // Speculative run-ahead frames are not part of the trace or profile
+    if(m_speculating) {
+        (this->*m_engine)();
+        return;
     }
 
-    if(m_sound_timer > 0) {
-        if(m_sound_timer == 1) {
-            std::cout << '\a'; // Beep
-        }
+    const uint16_t pc = m_pc & MEMORY_MASK;
+    const uint16_t opcode = (m_memory[pc] << 8) | m_memory[(pc + 1) & MEMORY_MASK];
 
-        --m_sound_timer;
+    if(m_trace_file) {
+        fprintf(m_trace_file, "%llu %03X %04X %s\n", (unsigned long long)m_instruction_count,
+                pc, opcode, disassemble(opcode).c_str());
     }
+
+    ++m_instruction_count;
+    ++m_opcode_counts[opcode >> 12];
+
+    (this->*m_engine)();
 }
 
 void CHIP8::updateScreen() {
@@ -494,7 +930,7 @@ void CHIP8::updateScreen() {
     for(uint32_t y = 0; y < 32; ++y) {
         for(uint32_t x = 0; x < 64; ++x) {
             // If pixel is set then set color to white, else set color to black
-            if(m_display[x + (y * 64)] == 1) {
+            if(m_presented_display[x + (y * 64)] == 1) {
                 SDL_SetRenderDrawColor(m_sdl.renderer, 0xFF, 0xFF, 0xFF, 0xFF);
             }
             else {
@@ -513,25 +949,302 @@ void CHIP8::updateScreen() {
     SDL_RenderPresent(m_sdl.renderer);
 }
 
-void CHIP8::run() {
-    std::cout << "Running CHIP8 emulator...\n";
+// Called once per real frame, after it can no longer be rewound
+void CHIP8::commitFrame() {
+    ++m_frame_count;
+
+    if(m_beep) {
+        std::cout << '\a'; // Beep
+        m_beep = false;
+    }
+}
+
+void CHIP8::presentFrame() {
+    memcpy(m_presented_display, m_display, sizeof(m_display));
+
+    clearScreen();
+
+    updateScreen();
+
+    // Input-to-present latency of the events applied in this frame
+    const uint32_t present_time = SDL_GetTicks();
+
+    for(const InputEvent &event : m_input_events) {
+        const uint32_t latency = present_time - event.timestamp;
+
+        ++m_latency.events;
+        m_latency.total_ms += latency;
+        m_latency.max_ms = std::max(m_latency.max_ms, latency);
+    }
+}
+
+void CHIP8::emulateFrames(uint32_t frames) {
+    static const std::vector<InputEvent> no_events;
+
+    // Display refreshes faster than 60 Hz, show the last frame again
+    if(frames == 0) {
+        clearScreen();
+        updateScreen();
+        return;
+    }
+
+    // Catching up, only the last frame is presented and input goes into the first one
+    const std::vector<InputEvent> *frame_events = &m_input_events;
+
+    for(; frames > 1 && m_fault.code == FAULT_NONE; --frames) {
+        runFrame(*frame_events);
+        frame_events = &no_events;
+        m_speculative_valid = false;
+    }
+
+    if(m_run_ahead_frames == 0) {
+        runFrame(*frame_events);
+        presentFrame();
+        return;
+    }
+
+    /*
+        Run-ahead: emulate the real frame, then keep emulating the following frames
+        with the current input held, present the last of them and rewind.
+
+        Without new input the real frame is identical to the first speculative frame
+        of the previous iteration, so that state is reused instead of re-emulated.
+        Tracing and profiling need every real instruction, so they never reuse it.
+    */
+    if(frame_events->empty() && m_speculative_valid && m_execute == m_engine) {
+        loadSnapshot(m_speculative_state);
+        commitFrame();
+    }
+    else {
+        runFrame(*frame_events);
+    }
+
+    saveSnapshot(m_frame_state);
+
+    m_speculating = true;
+    m_speculative_valid = false;
+
+    for(uint32_t frame = 0; frame < m_run_ahead_frames && m_fault.code == FAULT_NONE; ++frame) {
+        runFrame(no_events);
+
+        if(frame == 0 && m_fault.code == FAULT_NONE) {
+            saveSnapshot(m_speculative_state);
+            m_speculative_valid = true;
+        }
+    }
+
+    m_speculating = false;
+
+    presentFrame();
+
+    loadSnapshot(m_frame_state);
+}
+
+void CHIP8::reportLatency() const {
+    if(m_latency.events == 0) {
+        return;
+    }
 
+    const double average_ms = double(m_latency.total_ms) / m_latency.events;
+    const double run_ahead_ms = m_run_ahead_frames * 1000.0 / 60.0;
+
+    std::cout << "Input-to-present latency: average " << average_ms << " ms, max " << m_latency.max_ms
+              << " ms over " << m_latency.events << " key events\n";
+
+    if(m_run_ahead_frames > 0) {
+        std::cout << "Run-ahead presented emulated time " << m_run_ahead_frames << " frames (" << run_ahead_ms
+                  << " ms) ahead of input\n";
+    }
+}
+
+void CHIP8::runWindowed() {
     clearScreen();
     memset(m_display, 0, sizeof(m_display));
+
+    m_last_poll_time = SDL_GetTicks();
+    m_pacer.start(m_sdl.vsync_refresh_rate);
     
     while(m_emu_state != QUIT) {
         handleInput();
 
         if(m_emu_state == PAUSED) {
+            // Keep key state current while paused
+            for(const InputEvent &event : m_input_events) {
+                setKey(event.key, event.pressed);
+            }
+
+            m_input_events.clear();
+            m_speculative_valid = false;
+            m_last_poll_time = SDL_GetTicks();
+            m_pacer.resync();
+            SDL_Delay(1);
             continue;
         }
 
-        emulateInstruction();
+        // Input stays queued until a frame is due
+        const uint32_t paced_frames = m_emu_config.unthrottled ? 1 : m_pacer.beginFrame();
+        const uint32_t frames = paced_frames * std::max<uint32_t>(m_emu_config.turbo, 1);
 
-        clearScreen();
+        if(frames > 0) {
+            scheduleInput(SDL_GetTicks());
+        }
 
-        updateScreen();
+        emulateFrames(frames);
+
+        if(frames > 0) {
+            m_input_events.clear();
+        }
+
+        if(m_fault.code != FAULT_NONE) {
+            std::cerr << "ERROR: " << faultName(m_fault.code) << " at PC 0x" << std::hex << m_fault.pc
+                      << " (opcode 0x" << m_fault.opcode << ")" << std::dec << "\n";
+            m_emu_state = QUIT;
+            break;
+        }
+
+        if(m_emu_config.max_frames != 0 && m_frame_count >= m_emu_config.max_frames) {
+            m_emu_state = QUIT;
+        }
+
+        if(!m_emu_config.unthrottled) {
+            m_pacer.endFrame();
+        }
+    }
+}
+
+void CHIP8::runHeadless() {
+    static const std::vector<InputEvent> no_events;
+
+    m_pacer.start(0, false);
+
+    // A ROM pack is walked from the start ROM through every entry, max_frames each.
+    // A faulting ROM is logged and the walk moves on to the next one
+    const size_t rom_count = std::max<size_t>(m_rom_pack.size(), 1);
+    size_t roms_run = 0;
+    uint64_t rom_start_frame = m_frame_count;
+
+    // Quit cleanly on Ctrl-C, so the profile and trace are still written
+    s_interrupted = 0;
+    void (*previous_handler)(int) = std::signal(SIGINT, handleInterrupt);
+
+    while(m_emu_state != QUIT) {
+        if(s_interrupted) {
+            std::cout << "Interrupted, quitting...\n";
+            m_emu_state = QUIT;
+            break;
+        }
+
+        const uint32_t paced_frames = m_emu_config.unthrottled ? 1 : m_pacer.beginFrame();
+        const uint32_t frames = paced_frames * std::max<uint32_t>(m_emu_config.turbo, 1);
+
+        for(uint32_t frame = 0; frame < frames && m_emu_state != QUIT; ++frame) {
+            runFrame(no_events);
+
+            const bool faulted = m_fault.code != FAULT_NONE;
+            const bool finished = m_emu_config.max_frames != 0 &&
+                                  m_frame_count - rom_start_frame >= m_emu_config.max_frames;
+
+            if(faulted) {
+                const char *rom_name = m_rom_pack.size() > 0 ? m_rom_pack.at(m_rom_index).name : m_emu_config.rom_name;
 
-        SDL_Delay(1); // Workaround to slow down the emulator
+                std::cerr << "ERROR: " << rom_name << ": " << faultName(m_fault.code) << " at PC 0x" << std::hex
+                          << m_fault.pc << " (opcode 0x" << m_fault.opcode << ")" << std::dec << "\n";
+                ++m_faulted_roms;
+            }
+
+            if(!faulted && !finished) {
+                continue;
+            }
+
+            if(++roms_run == rom_count) {
+                m_emu_state = QUIT;
+            }
+            else {
+                loadNextPackROM();
+                rom_start_frame = m_frame_count;
+            }
+        }
+
+        if(!m_emu_config.unthrottled) {
+            m_pacer.endFrame();
+        }
+    }
+
+    std::signal(SIGINT, previous_handler);
+
+    if(m_rom_pack.size() > 0) {
+        std::cout << "Ran " << roms_run << " of " << m_rom_pack.size() << " ROMs, "
+                  << m_faulted_roms << " faulted\n";
+    }
+}
+
+void CHIP8::writeProfile(double elapsed_s) const {
+    FILE *profile = fopen(m_emu_config.profile_path, "w");
+    if(!profile) {
+        std::cerr << "ERROR: Failed to open profile file " << m_emu_config.profile_path << "!\n";
+        return;
+    }
+
+    const FramePacingStats &pacing = m_pacer.stats();
+
+    fprintf(profile, "engine: %s\n", m_emu_config.engine == ENGINE_TABLE ? "table" : "switch");
+    fprintf(profile, "quirks: %s\n", quirksName(m_quirks));
+    fprintf(profile, "instructions_per_frame: %u\n", m_instructions_per_frame);
+    fprintf(profile, "elapsed_s: %.6f\n", elapsed_s);
+    fprintf(profile, "frames: %llu\n", (unsigned long long)m_frame_count);
+    fprintf(profile, "instructions: %llu\n", (unsigned long long)m_instruction_count);
+    fprintf(profile, "frames_per_s: %.2f\n", elapsed_s > 0 ? m_frame_count / elapsed_s : 0.0);
+    fprintf(profile, "instructions_per_s: %.0f\n", elapsed_s > 0 ? m_instruction_count / elapsed_s : 0.0);
+
+    fprintf(profile, "catch_up_frames: %llu\n", (unsigned long long)pacing.catch_up_frames);
+    fprintf(profile, "skipped_frames: %llu\n", (unsigned long long)pacing.skipped_frames);
+    // Headless runs present nothing, their loop is paced per frame
+    const char *interval = m_emu_config.headless ? "frame" : "present";
+
+    fprintf(profile, "%s_interval_mean_ms: %.4f\n", interval, pacing.interval_mean_ms);
+    fprintf(profile, "%s_interval_stddev_ms: %.4f\n", interval, pacing.stddev());
+    fprintf(profile, "%s_jitter_max_ms: %.4f\n", interval, pacing.jitter_max_ms);
+
+    fprintf(profile, "input_events: %llu\n", (unsigned long long)m_latency.events);
+    fprintf(profile, "input_latency_mean_ms: %.2f\n",
+            m_latency.events ? double(m_latency.total_ms) / m_latency.events : 0.0);
+    fprintf(profile, "input_latency_max_ms: %u\n", m_latency.max_ms);
+
+    // Executed instructions by opcode group
+    for(uint32_t group = 0; group < 16; ++group) {
+        fprintf(profile, "opcodes_%XNNN: %llu\n", group, (unsigned long long)m_opcode_counts[group]);
     }
+
+    fclose(profile);
+
+    std::cout << "Wrote profile to " << m_emu_config.profile_path << "\n";
+}
+
+bool CHIP8::run() {
+    std::cout << "Running CHIP8 emulator...\n";
+
+    const uint64_t start_time = SDL_GetPerformanceCounter();
+
+    if(m_emu_config.headless) {
+        runHeadless();
+    }
+    else {
+        runWindowed();
+    }
+
+    const double elapsed_s = double(SDL_GetPerformanceCounter() - start_time) / SDL_GetPerformanceFrequency();
+
+    std::cout << "Emulated " << m_frame_count << " frames in " << elapsed_s << " s\n";
+
+    reportLatency();
+
+    if(!m_emu_config.unthrottled) {
+        m_pacer.report();
+    }
+
+    if(m_emu_config.profile_path) {
+        writeProfile(elapsed_s);
+    }
+
+    return m_fault.code == FAULT_NONE && m_faulted_roms == 0;
 }
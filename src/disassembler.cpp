@@ -0,0 +1,79 @@
+#include "../inc/disassembler.hpp"
+
+#include <cstdio>
+
+bool isValidOpcode(uint16_t opcode) {
+    switch(opcode & 0xF000u) {
+        case 0x0000:
+            return (opcode & 0x00FFu) == 0x00E0 || (opcode & 0x00FFu) == 0x00EE;
+        case 0x8000:
+            return (opcode & 0x000Fu) <= 0x0007 || (opcode & 0x000Fu) == 0x000E;
+        case 0xE000:
+            return (opcode & 0x00FFu) == 0x009E || (opcode & 0x00FFu) == 0x00A1;
+        case 0xF000:
+            switch(opcode & 0x00FFu) {
+                case 0x0007: case 0x000A: case 0x0015: case 0x0018: case 0x001E:
+                case 0x0029: case 0x0033: case 0x0055: case 0x0065:
+                    return true;
+                default:
+                    return false;
+            }
+        default:
+            return true;
+    }
+}
+
+std::string disassemble(uint16_t opcode) {
+    const unsigned X = (opcode & 0x0F00) >> 8;
+    const unsigned Y = (opcode & 0x00F0) >> 4;
+    const unsigned N = opcode & 0x000F;
+    const unsigned NN = opcode & 0x00FF;
+    const unsigned NNN = opcode & 0x0FFF;
+
+    char text[32];
+
+    if(!isValidOpcode(opcode)) {
+        snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+        return text;
+    }
+
+    switch(opcode & 0xF000u) {
+        case 0x0000: snprintf(text, sizeof(text), NN == 0xE0 ? "CLS" : "RET"); break;
+        case 0x1000: snprintf(text, sizeof(text), "JP 0x%03X", NNN); break;
+        case 0x2000: snprintf(text, sizeof(text), "CALL 0x%03X", NNN); break;
+        case 0x3000: snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN); break;
+        case 0x4000: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN); break;
+        case 0x5000: snprintf(text, sizeof(text), "SE V%X, V%X", X, Y); break;
+        case 0x6000: snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN); break;
+        case 0x7000: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN); break;
+        case 0x8000: {
+            static const char *const names[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                "", "", "", "", "", "", "SHL", ""
+            };
+            snprintf(text, sizeof(text), "%s V%X, V%X", names[N], X, Y);
+            break;
+        }
+        case 0x9000: snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y); break;
+        case 0xA000: snprintf(text, sizeof(text), "LD I, 0x%03X", NNN); break;
+        case 0xB000: snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN); break;
+        case 0xC000: snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN); break;
+        case 0xD000: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N); break;
+        case 0xE000: snprintf(text, sizeof(text), "%s V%X", NN == 0x9E ? "SKP" : "SKNP", X); break;
+        case 0xF000:
+            switch(NN) {
+                case 0x07: snprintf(text, sizeof(text), "LD V%X, DT", X); break;
+                case 0x0A: snprintf(text, sizeof(text), "LD V%X, K", X); break;
+                case 0x15: snprintf(text, sizeof(text), "LD DT, V%X", X); break;
+                case 0x18: snprintf(text, sizeof(text), "LD ST, V%X", X); break;
+                case 0x1E: snprintf(text, sizeof(text), "ADD I, V%X", X); break;
+                case 0x29: snprintf(text, sizeof(text), "LD F, V%X", X); break;
+                case 0x33: snprintf(text, sizeof(text), "LD B, V%X", X); break;
+                case 0x55: snprintf(text, sizeof(text), "LD [I], V%X", X); break;
+                case 0x65: snprintf(text, sizeof(text), "LD V%X, [I]", X); break;
+            }
+            break;
+    }
+
+    return text;
+}
@@ -1,12 +1,17 @@
 #include "../inc/emulator_base.hpp"
 
-EmulatorBase::EmulatorBase() {}
+EmulatorBase::EmulatorBase() : m_sdl{nullptr, nullptr, 0}, m_emu_config{} {}
 
-EmulatorBase::EmulatorBase(const EmulatorConfig &emu_config) {
+EmulatorBase::EmulatorBase(const EmulatorConfig &emu_config) : m_sdl{nullptr, nullptr, 0} {
     std::cout << "Initializing emulator base..." << '\n';
 
     initConfig(emu_config);
 
+    // Headless instances never touch SDL
+    if(m_emu_config.headless) {
+        return;
+    }
+
     if(!initSDL()) {
         exit(EXIT_FAILURE);
     }
@@ -16,6 +21,10 @@ EmulatorBase::EmulatorBase(const EmulatorConfig &emu_config) {
 
 // Clean up after terminating the program
 EmulatorBase::~EmulatorBase() {
+    if(m_emu_config.headless) {
+        return;
+    }
+
     SDL_DestroyRenderer(m_sdl.renderer);
     SDL_DestroyWindow(m_sdl.window);
     SDL_Quit();
@@ -45,14 +54,35 @@ bool EmulatorBase::initSDL() {
         return false;
     }
 
+    // Sync presents to vsync only when the refresh rate is a multiple of 60 Hz,
+    // otherwise the frame pacer times frames itself. Unthrottled runs never wait
+    uint32_t renderer_flags = SDL_RENDERER_ACCELERATED;
+    uint32_t refresh_rate = 0;
+    SDL_DisplayMode display_mode;
+
+    if(!m_emu_config.unthrottled &&
+       SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(m_sdl.window), &display_mode) == 0 &&
+       display_mode.refresh_rate > 0 && display_mode.refresh_rate % 60 == 0) {
+        renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+        refresh_rate = display_mode.refresh_rate;
+    }
+
     // Initialize SDL Renderer
-    m_sdl.renderer = SDL_CreateRenderer(m_sdl.window, -1, SDL_RENDERER_ACCELERATED);
+    m_sdl.renderer = SDL_CreateRenderer(m_sdl.window, -1, renderer_flags);
 
     if(!m_sdl.renderer) {
         SDL_Log("Could not create SDL Renderer %s\n", SDL_GetError());
         return false;
     }
 
+    // The renderer can still come up without vsync, then the frame pacer times frames itself
+    SDL_RendererInfo renderer_info;
+
+    if(refresh_rate != 0 && SDL_GetRendererInfo(m_sdl.renderer, &renderer_info) == 0 &&
+       (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC)) {
+        m_sdl.vsync_refresh_rate = refresh_rate;
+    }
+
     return true;
 }
 
@@ -0,0 +1,130 @@
+#include "../inc/frame_pacer.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <SDL2/SDL.h>
+
+double FramePacingStats::stddev() const {
+    return presents > 1 ? std::sqrt(interval_m2 / (presents - 1)) : 0.0;
+}
+
+FramePacer::FramePacer(uint32_t target_hz, uint32_t max_catch_up) {
+    m_frequency = SDL_GetPerformanceFrequency();
+    m_period = m_frequency / target_hz;
+    m_present_period = m_period;
+    m_spin_threshold = m_frequency / 500; // 2 ms
+    m_max_catch_up = std::max<uint32_t>(max_catch_up, 1);
+    m_vsync = false;
+    m_presenting = true;
+
+    m_next_deadline = 0;
+    m_last_begin = 0;
+    m_stats = {};
+}
+
+uint64_t FramePacer::now() const {
+    return SDL_GetPerformanceCounter();
+}
+
+void FramePacer::start(uint32_t refresh_rate, bool presenting) {
+    m_vsync = refresh_rate > 0;
+    m_presenting = presenting;
+    m_present_period = m_vsync ? m_frequency / refresh_rate : m_period;
+    m_stats = {};
+
+    resync();
+}
+
+void FramePacer::resync() {
+    m_next_deadline = now();
+    m_last_begin = 0;
+}
+
+void FramePacer::recordInterval(uint64_t interval) {
+    const double interval_ms = interval * 1000.0 / m_frequency;
+    const double expected_ms = m_present_period * 1000.0 / m_frequency;
+
+    // Welford's running mean and variance
+    ++m_stats.presents;
+    const double delta = interval_ms - m_stats.interval_mean_ms;
+    m_stats.interval_mean_ms += delta / m_stats.presents;
+    m_stats.interval_m2 += delta * (interval_ms - m_stats.interval_mean_ms);
+
+    if(m_stats.presents == 1) {
+        m_stats.interval_min_ms = interval_ms;
+        m_stats.interval_max_ms = interval_ms;
+    }
+
+    m_stats.interval_min_ms = std::min(m_stats.interval_min_ms, interval_ms);
+    m_stats.interval_max_ms = std::max(m_stats.interval_max_ms, interval_ms);
+    m_stats.jitter_max_ms = std::max(m_stats.jitter_max_ms, std::fabs(interval_ms - expected_ms));
+}
+
+uint32_t FramePacer::beginFrame() {
+    const uint64_t current = now();
+
+    if(m_last_begin != 0) {
+        recordInterval(current - m_last_begin);
+    }
+    m_last_begin = current;
+
+    // With vsync, present timing is fixed by the display. Half a period of slack keeps
+    // the frame count steady when vblanks land right on the emulated frame deadlines
+    const uint64_t slack = m_vsync ? m_period / 2 : 0;
+
+    if(current + slack < m_next_deadline) {
+        return 0;
+    }
+
+    uint64_t due = 1 + (current + slack - m_next_deadline) / m_period;
+
+    if(due > m_max_catch_up) {
+        // Stalled for too long, drop the backlog instead of running fast for a while
+        m_stats.skipped_frames += due - 1;
+        m_next_deadline = current;
+        due = 1;
+    }
+
+    m_stats.catch_up_frames += due - 1;
+    m_stats.frames += due;
+    m_next_deadline += due * m_period;
+
+    return static_cast<uint32_t>(due);
+}
+
+void FramePacer::endFrame() {
+    // SDL_RenderPresent already blocked until vblank
+    if(m_vsync) {
+        return;
+    }
+
+    uint64_t current = now();
+
+    // Coarse sleep, the OS timer can oversleep by a millisecond or more
+    if(current + m_spin_threshold < m_next_deadline) {
+        const uint64_t sleep_ticks = m_next_deadline - current - m_spin_threshold;
+        SDL_Delay(static_cast<uint32_t>(sleep_ticks * 1000 / m_frequency));
+    }
+
+    // Spin for the remaining fraction of the frame
+    do {
+        current = now();
+    } while(current < m_next_deadline);
+}
+
+const FramePacingStats& FramePacer::stats() const {
+    return m_stats;
+}
+
+void FramePacer::report() const {
+    if(m_stats.presents == 0) {
+        return;
+    }
+
+    std::cout << "Frame pacing" << (m_vsync ? " (vsync)" : "") << ": " << m_stats.frames << " frames, "
+              << m_stats.catch_up_frames << " caught up, " << m_stats.skipped_frames << " skipped\n";
+    std::cout << (m_presenting ? "Present" : "Frame") << " interval: mean " << m_stats.interval_mean_ms << " ms, stddev " << m_stats.stddev()
+              << " ms, min " << m_stats.interval_min_ms << " ms, max " << m_stats.interval_max_ms
+              << " ms, max jitter " << m_stats.jitter_max_ms << " ms\n";
+}
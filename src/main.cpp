@@ -1,21 +1,49 @@
 #include "../inc/chip8.hpp"
+#include "../inc/verifier.hpp"
+#include "../inc/options.hpp"
 
 int main(int argc, char **argv) {
-    if(argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <ROM file>" << '\n';
+    Options options;
+
+    if(!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    EmulatorConfig emu_config = {
-        64, 32,      // Original CHIP8 resolution
-        0xFFFFFFFF,  // Foreground color (white)
-        0x00FFFFFF,  // Background color (black)
-        20,          // Scale factor
-        argv[1]      // ROM file name
-    };
+    const EmulatorConfig &emu_config = options.emu_config;
+
+    // Build a ROM pack from the given ROM files
+    if(options.mode == MODE_PACK) {
+        return RomPack::build(options.rom_name.c_str(), options.pack_sources) ? 0 : EXIT_FAILURE;
+    }
+
+    // Run the selected engine against the reference switch engine
+    if(options.mode == MODE_VERIFY || options.mode == MODE_FUZZ) {
+        VerifierConfig verifier_config = {
+            ENGINE_SWITCH,  // Reference engine
+            emu_config.engine == ENGINE_SWITCH ? ENGINE_TABLE : emu_config.engine,
+            options.verify_instructions,
+            options.check_interval,
+            options.input_interval,
+            emu_config.instructions_per_frame,
+            emu_config.rng_seed != 0 ? emu_config.rng_seed : 1,  // Reproducible unless --seed is given
+            emu_config.quirks
+        };
+
+        Verifier verifier(verifier_config);
+
+        if(options.mode == MODE_VERIFY) {
+            return verifier.verifyFile(options.rom_name.c_str()) ? 0 : EXIT_FAILURE;
+        }
+
+        return verifier.fuzz(options.fuzz_cases) ? 0 : EXIT_FAILURE;
+    }
 
     CHIP8 emulator(emu_config);
-    emulator.run();
 
-    return 0;
+    if(emulator.fault().code != FAULT_NONE) {
+        return EXIT_FAILURE;
+    }
+
+    return emulator.run() ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,403 @@
+#include "../inc/options.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <utility>
+
+Options::Options() {
+    mode = MODE_RUN;
+
+    emu_config = {
+        64, 32,         // Original CHIP8 resolution
+        0xFFFFFFFF,     // Foreground color (white)
+        0x00FFFFFF,     // Background color (black)
+        20,             // Scale factor
+        nullptr,        // ROM file name
+        false,          // Windowed
+        0,              // Seed from the clock
+        ENGINE_SWITCH,
+        10,             // Instructions per frame
+        0,              // No run-ahead
+        false,          // Paced to 60 Hz
+        1,              // No turbo
+        0,              // Run until quit
+        QUIRKS_MODERN,
+        nullptr,        // No profile
+        nullptr,        // No trace
+        nullptr         // Start with the first ROM of a pack
+    };
+
+    verify_instructions = 1000000;
+    check_interval = 1000;
+    input_interval = 97;
+    fuzz_cases = 1000000;
+}
+
+// Decimal only: no sign, no leading whitespace and no octal or hex prefixes
+static bool parseNumber(const std::string &value, uint64_t &number) {
+    if(value.empty() || !isdigit(static_cast<unsigned char>(value[0]))) {
+        return false;
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    number = strtoull(value.c_str(), &end, 10);
+
+    return *end == '\0' && errno != ERANGE;
+}
+
+static bool parseNumber(const std::string &value, uint32_t &number) {
+    uint64_t wide_number;
+    if(!parseNumber(value, wide_number) || wide_number > UINT32_MAX) {
+        return false;
+    }
+
+    number = static_cast<uint32_t>(wide_number);
+    return true;
+}
+
+static bool parseBool(const std::string &value, bool &flag) {
+    if(value == "true" || value == "1" || value == "yes") {
+        flag = true;
+        return true;
+    }
+
+    if(value == "false" || value == "0" || value == "no") {
+        flag = false;
+        return true;
+    }
+
+    return false;
+}
+
+static bool parseQuirks(const std::string &value, QuirkProfile &quirks) {
+    if(value == "modern")     quirks = QUIRKS_MODERN;
+    else if(value == "vip")   quirks = QUIRKS_COSMAC_VIP;
+    else if(value == "schip") quirks = QUIRKS_SCHIP;
+    else                      return false;
+
+    return true;
+}
+
+// ROM file with optional pack metadata, <ROM file>[:<ipf>[:<quirks>]]. Empty fields use the emulator default
+static bool parsePackSource(const std::string &argument, std::string &rom_name, RomPackSource &source) {
+    const size_t ipf_separator = argument.find(':');
+
+    rom_name = argument.substr(0, ipf_separator);
+    source = {nullptr, 0, 0};
+
+    bool valid = !rom_name.empty();
+
+    if(valid && ipf_separator != std::string::npos) {
+        const std::string metadata = argument.substr(ipf_separator + 1);
+        const size_t quirks_separator = metadata.find(':');
+        const std::string ipf = metadata.substr(0, quirks_separator);
+        const std::string quirks = quirks_separator == std::string::npos ? "" : metadata.substr(quirks_separator + 1);
+
+        uint32_t instructions_per_frame = 0;
+        if(!ipf.empty()) {
+            valid = parseNumber(ipf, instructions_per_frame) && instructions_per_frame > 0 &&
+                    instructions_per_frame <= UINT16_MAX;
+            source.instructions_per_frame = static_cast<uint16_t>(instructions_per_frame);
+        }
+
+        // Stored as the profile + 1, 0 keeps the emulator default
+        QuirkProfile profile = QUIRKS_MODERN;
+        if(valid && !quirks.empty()) {
+            valid = parseQuirks(quirks, profile);
+            source.quirk_profile = static_cast<uint8_t>(profile + 1);
+        }
+    }
+
+    if(!valid) {
+        std::cerr << "ERROR: Invalid ROM pack entry '" << argument << "', expected <ROM file>[:<ipf>[:<quirks>]]\n";
+    }
+
+    return valid;
+}
+
+static bool isFlag(const std::string &key) {
+    return key == "headless" || key == "windowed" || key == "unthrottled" ||
+           key == "pack" || key == "verify" || key == "fuzz";
+}
+
+// Applies a single option, shared by the command line and config files
+static bool applyOption(const std::string &key, const std::string &value, Options &options) {
+    EmulatorConfig &emu_config = options.emu_config;
+    bool flag = false;
+    bool valid = true;
+
+    if(key == "headless") {
+        valid = parseBool(value, emu_config.headless);
+    }
+    else if(key == "windowed") {
+        valid = parseBool(value, flag);
+        emu_config.headless = !flag;
+    }
+    else if(key == "unthrottled") {
+        valid = parseBool(value, emu_config.unthrottled);
+    }
+    else if(key == "turbo") {
+        valid = parseNumber(value, emu_config.turbo) && emu_config.turbo > 0;
+    }
+    else if(key == "ipf") {
+        valid = parseNumber(value, emu_config.instructions_per_frame) && emu_config.instructions_per_frame > 0;
+    }
+    else if(key == "run-ahead") {
+        valid = parseNumber(value, emu_config.run_ahead_frames);
+    }
+    else if(key == "frames") {
+        valid = parseNumber(value, emu_config.max_frames);
+    }
+    else if(key == "scale") {
+        valid = parseNumber(value, emu_config.scale_factor) && emu_config.scale_factor > 0;
+    }
+    else if(key == "seed") {
+        valid = parseNumber(value, emu_config.rng_seed);
+    }
+    else if(key == "engine") {
+        if(value == "switch")     emu_config.engine = ENGINE_SWITCH;
+        else if(value == "table") emu_config.engine = ENGINE_TABLE;
+        else                      valid = false;
+    }
+    else if(key == "quirks") {
+        valid = parseQuirks(value, emu_config.quirks);
+    }
+    else if(key == "profile") {
+        options.profile_path = value;
+    }
+    else if(key == "trace") {
+        options.trace_path = value;
+    }
+    else if(key == "start-rom") {
+        options.start_rom = value;
+    }
+    else if(key == "instructions") {
+        valid = parseNumber(value, options.verify_instructions);
+    }
+    else if(key == "check-interval") {
+        valid = parseNumber(value, options.check_interval) && options.check_interval > 0;
+    }
+    else if(key == "input-interval") {
+        valid = parseNumber(value, options.input_interval);
+    }
+    else if(key == "pack" || key == "verify" || key == "fuzz") {
+        valid = parseBool(value, flag);
+
+        if(flag) {
+            options.mode = key == "pack" ? MODE_PACK : key == "verify" ? MODE_VERIFY : MODE_FUZZ;
+        }
+    }
+    else {
+        std::cerr << "ERROR: Unknown option '" << key << "'\n";
+        return false;
+    }
+
+    if(!valid) {
+        std::cerr << "ERROR: Invalid value '" << value << "' for option '" << key << "'\n";
+    }
+
+    return valid;
+}
+
+static bool loadConfigFile(const std::string &config_path, bool required, Options &options) {
+    std::ifstream config(config_path);
+
+    if(!config) {
+        if(required) {
+            std::cerr << "ERROR: Failed to open config file " << config_path << "!\n";
+        }
+        return !required;
+    }
+
+    std::cout << "Loading config file " << config_path << "...\n";
+
+    // One "key = value" per line, '#' starts a comment
+    std::string line;
+    uint32_t line_number = 0;
+
+    while(std::getline(config, line)) {
+        ++line_number;
+
+        line = line.substr(0, line.find('#'));
+
+        const size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos) {
+            continue;
+        }
+
+        const size_t separator = line.find('=');
+        if(separator == std::string::npos) {
+            std::cerr << "ERROR: " << config_path << ":" << line_number << ": expected key = value\n";
+            return false;
+        }
+
+        auto trim = [](const std::string &text) {
+            const size_t begin = text.find_first_not_of(" \t\r");
+            const size_t end = text.find_last_not_of(" \t\r");
+            return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+        };
+
+        const std::string key = trim(line.substr(0, separator));
+
+        if(key == "pack" || key == "verify" || key == "fuzz") {
+            std::cerr << "ERROR: " << config_path << ":" << line_number << ": '" << key
+                      << "' is only valid on the command line\n";
+            return false;
+        }
+
+        if(!applyOption(key, trim(line.substr(separator + 1)), options)) {
+            std::cerr << "ERROR: in " << config_path << ":" << line_number << "\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    std::vector<std::pair<std::string, std::string>> cli_options;
+    std::vector<std::string> arguments;
+
+    // Split the command line, options are applied after the config file
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "--", 2) != 0) {
+            arguments.push_back(argv[i]);
+            continue;
+        }
+
+        const std::string key = argv[i] + 2;
+
+        if(key == "config") {
+            if(i + 1 >= argc) {
+                std::cerr << "ERROR: Missing value for option 'config'\n";
+                return false;
+            }
+
+            options.config_path = argv[++i];
+        }
+        else if(isFlag(key)) {
+            cli_options.push_back({key, "true"});
+        }
+        else {
+            if(i + 1 >= argc) {
+                std::cerr << "ERROR: Missing value for option '" << key << "'\n";
+                return false;
+            }
+
+            cli_options.push_back({key, argv[++i]});
+        }
+    }
+
+    // The mode decides what the positional arguments are
+    for(const auto &option : cli_options) {
+        if(isFlag(option.first) && !applyOption(option.first, option.second, options)) {
+            return false;
+        }
+    }
+
+    switch(options.mode) {
+        case MODE_PACK:
+            if(arguments.size() < 2) {
+                std::cerr << "ERROR: Expected a ROM pack and at least one ROM file\n";
+                return false;
+            }
+
+            options.rom_name = arguments[0];
+
+            for(size_t i = 1; i < arguments.size(); ++i) {
+                std::string rom_name;
+                RomPackSource source;
+
+                if(!parsePackSource(arguments[i], rom_name, source)) {
+                    return false;
+                }
+
+                options.pack_rom_names.push_back(rom_name);
+                options.pack_sources.push_back(source);
+            }
+
+            // Names no longer move once every ROM is added
+            for(size_t i = 0; i < options.pack_sources.size(); ++i) {
+                options.pack_sources[i].rom_name = options.pack_rom_names[i].c_str();
+            }
+            break;
+
+        case MODE_FUZZ:
+            if(arguments.size() != 1 || !parseNumber(arguments[0], options.fuzz_cases)) {
+                std::cerr << "ERROR: Expected the number of random instructions to fuzz\n";
+                return false;
+            }
+            break;
+
+        case MODE_RUN:
+        case MODE_VERIFY:
+            if(arguments.size() != 1) {
+                std::cerr << "ERROR: Expected exactly one ROM file or ROM pack\n";
+                return false;
+            }
+
+            options.rom_name = arguments[0];
+            break;
+    }
+
+    // Config file: explicit, or the optional per-ROM <ROM file>.cfg
+    if(!options.config_path.empty()) {
+        if(!loadConfigFile(options.config_path, true, options)) {
+            return false;
+        }
+    }
+    else if(options.mode == MODE_RUN || options.mode == MODE_VERIFY) {
+        if(!loadConfigFile(options.rom_name + ".cfg", false, options)) {
+            return false;
+        }
+    }
+
+    // Command line options take precedence over the config file
+    for(const auto &option : cli_options) {
+        if(!applyOption(option.first, option.second, options)) {
+            return false;
+        }
+    }
+
+    options.emu_config.rom_name = options.rom_name.c_str();
+    options.emu_config.profile_path = options.profile_path.empty() ? nullptr : options.profile_path.c_str();
+    options.emu_config.trace_path = options.trace_path.empty() ? nullptr : options.trace_path.c_str();
+    options.emu_config.start_rom = options.start_rom.empty() ? nullptr : options.start_rom.c_str();
+
+    return true;
+}
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <ROM file | ROM pack>\n"
+              << "       " << program << " --pack <ROM pack> <ROM file[:ipf[:quirks]]...>\n"
+              << "       " << program << " [options] --verify <ROM file | ROM pack>\n"
+              << "       " << program << " [options] --fuzz <instructions>\n"
+              << "\n"
+              << "Options:\n"
+              << "  --config <file>      Config file, defaults to <ROM file>.cfg when it exists\n"
+              << "  --headless           Run without a window\n"
+              << "  --windowed           Run with a window (default)\n"
+              << "  --ipf <n>            Instructions per frame (default 10)\n"
+              << "  --unthrottled        Run as fast as possible\n"
+              << "  --turbo <n>          Emulate n frames per paced frame (default 1)\n"
+              << "  --frames <n>         Stop after n frames, per ROM when running a pack headless (default 0, run until quit)\n"
+              << "  --run-ahead <n>      Frames emulated ahead of input (default 0)\n"
+              << "  --engine <name>      switch or table (default switch)\n"
+              << "  --quirks <name>      modern, vip or schip (default modern)\n"
+              << "  --seed <n>           Random seed (default 0, seed from the clock; 1 in verify and fuzz mode)\n"
+              << "  --scale <n>          Window scale factor (default 20)\n"
+              << "  --profile <file>     Write run statistics to file\n"
+              << "  --trace <file>       Write an instruction trace to file\n"
+              << "  --start-rom <rom>    ROM pack entry to start with, by file name or hash (default first)\n"
+              << "  --instructions <n>   Instructions per ROM in verify mode (default 1000000)\n"
+              << "  --check-interval <n> Compare engine states every n instructions (default 1000)\n"
+              << "  --input-interval <n> Inject a key event every n instructions, 0 = none (default 97)\n"
+              << "\n"
+              << "Config files use one 'option = value' per line, e.g. 'ipf = 15' or 'headless = true'.\n"
+              << "ROM pack entries can set instructions per frame and quirks, e.g. 'pong.ch8:15:vip' or 'maze.ch8::schip'.\n";
+}
@@ -0,0 +1,280 @@
+#include "../inc/rom_pack.hpp"
+#include "../inc/chip8_utils.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+RomPack::RomPack() : m_data(nullptr), m_size(0), m_header(nullptr), m_entries(nullptr), m_hash_index(nullptr) {}
+
+RomPack::~RomPack() {
+    close();
+}
+
+bool RomPack::open(const char *pack_name) {
+    close();
+
+    std::cout << "Opening ROM pack " << pack_name << "...\n";
+
+    const int fd = ::open(pack_name, O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "ERROR: Failed to open ROM pack " << pack_name << "!\n";
+        return false;
+    }
+
+    struct stat pack_stat;
+    if(fstat(fd, &pack_stat) != 0 || pack_stat.st_size < (off_t)sizeof(RomPackHeader)) {
+        std::cerr << "ERROR: ROM pack " << pack_name << " is too small!\n";
+        ::close(fd);
+        return false;
+    }
+
+    // Map the whole pack once, ROM images are read straight from the mapping
+    void *mapping = mmap(nullptr, pack_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(mapping == MAP_FAILED) {
+        std::cerr << "ERROR: Failed to map ROM pack " << pack_name << "!\n";
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_size = pack_stat.st_size;
+    m_header = reinterpret_cast<const RomPackHeader*>(m_data);
+    m_entries = reinterpret_cast<const RomPackEntry*>(m_data + sizeof(RomPackHeader));
+    m_hash_index = nullptr;
+
+    // Validate header
+    if(memcmp(m_header->magic, ROM_PACK_MAGIC, sizeof(ROM_PACK_MAGIC)) != 0 ||
+       m_header->version != ROM_PACK_VERSION) {
+        std::cerr << "ERROR: " << pack_name << " is not a supported ROM pack!\n";
+        close();
+        return false;
+    }
+
+    const size_t entries_end = sizeof(RomPackHeader) + size_t(m_header->entry_count) * sizeof(RomPackEntry);
+    const size_t table_end = entries_end + size_t(m_header->entry_count) * sizeof(uint32_t);
+    if(table_end > m_size) {
+        std::cerr << "ERROR: ROM pack " << pack_name << " has a truncated entry table!\n";
+        close();
+        return false;
+    }
+
+    m_hash_index = reinterpret_cast<const uint32_t*>(m_data + entries_end);
+
+    // Validate entries so lookups never have to
+    for(uint32_t i = 0; i < m_header->entry_count; ++i) {
+        const RomPackEntry &entry = m_entries[i];
+
+        if(size_t(entry.offset) + entry.size > m_size || entry.size > MEMORY_SIZE - START_ADDRESS ||
+           entry.name[ROM_PACK_NAME_SIZE - 1] != '\0') {
+            std::cerr << "ERROR: ROM pack " << pack_name << " has an invalid entry(" << i << ")!\n";
+            close();
+            return false;
+        }
+    }
+
+    // find() binary searches the hash index, so it must be strictly sorted by hash
+    for(uint32_t i = 0; i < m_header->entry_count; ++i) {
+        const bool sorted = m_hash_index[i] < m_header->entry_count &&
+                            (i == 0 || m_entries[m_hash_index[i - 1]].hash < m_entries[m_hash_index[i]].hash);
+
+        if(!sorted) {
+            std::cerr << "ERROR: ROM pack " << pack_name << " has an unsorted hash index!\n";
+            close();
+            return false;
+        }
+    }
+
+    std::cout << "Succesfully opened ROM pack " << pack_name << " (" << size() << " ROMs)!\n";
+    return true;
+}
+
+void RomPack::close() {
+    if(m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_entries = nullptr;
+    m_hash_index = nullptr;
+}
+
+size_t RomPack::size() const {
+    return m_header ? m_header->entry_count : 0;
+}
+
+RomImage RomPack::at(size_t index) const {
+    const RomPackEntry &entry = m_entries[index];
+
+    return {
+        m_data + entry.offset,
+        entry.size,
+        entry.hash,
+        entry.instructions_per_frame,
+        entry.quirk_profile,
+        entry.name
+    };
+}
+
+bool RomPack::find(uint64_t hash, size_t &index) const {
+    const uint32_t *begin = m_hash_index;
+    const uint32_t *end = m_hash_index + size();
+
+    // The hash index is sorted by entry hash
+    const uint32_t *entry = std::lower_bound(begin, end, hash,
+        [this](uint32_t i, uint64_t h) { return m_entries[i].hash < h; });
+
+    if(entry == end || m_entries[*entry].hash != hash) {
+        return false;
+    }
+
+    index = *entry;
+    return true;
+}
+
+bool RomPack::findByName(const char *rom_name, size_t &index) const {
+    for(size_t i = 0; i < size(); ++i) {
+        if(strcmp(m_entries[i].name, rom_name) == 0) {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RomPack::isPackFile(const char *file_name) {
+    FILE *file = fopen(file_name, "rb");
+    if(!file) {
+        return false;
+    }
+
+    char magic[sizeof(ROM_PACK_MAGIC)] = {};
+    const bool is_pack = fread(magic, sizeof(magic), 1, file) == 1 &&
+                         memcmp(magic, ROM_PACK_MAGIC, sizeof(magic)) == 0;
+
+    fclose(file);
+    return is_pack;
+}
+
+bool RomPack::build(const char *pack_name, const std::vector<RomPackSource> &sources) {
+    std::cout << "Building ROM pack " << pack_name << "...\n";
+
+    std::vector<RomPackEntry> entries;
+    std::vector<std::vector<uint8_t>> images;
+
+    for(const RomPackSource &source : sources) {
+        // Read ROM file
+        FILE *rom = fopen(source.rom_name, "rb");
+        if(!rom) {
+            std::cerr << "ERROR: Failed to open ROM file " << source.rom_name << "!\n";
+            return false;
+        }
+
+        fseek(rom, 0, SEEK_END);
+        const size_t rom_size = ftell(rom);
+        const size_t max_size = MEMORY_SIZE - START_ADDRESS;
+        rewind(rom);
+
+        if(rom_size == 0 || rom_size > max_size) {
+            std::cerr << "ERROR: ROM file " << source.rom_name << " has an invalid size(" << rom_size << ")!\n";
+            fclose(rom);
+            return false;
+        }
+
+        std::vector<uint8_t> image(rom_size);
+        const bool read_ok = fread(image.data(), rom_size, 1, rom) == 1;
+        fclose(rom);
+
+        if(!read_ok) {
+            std::cerr << "ERROR: Could not read ROM file " << source.rom_name << "\n";
+            return false;
+        }
+
+        RomPackEntry entry = {};
+        entry.hash = fnv1a(image.data(), image.size());
+        entry.size = static_cast<uint16_t>(rom_size);
+        entry.instructions_per_frame = source.instructions_per_frame;
+        entry.quirk_profile = source.quirk_profile;
+
+        // Store the base name only, truncated to fit the entry
+        const char *base_name = strrchr(source.rom_name, '/');
+        base_name = base_name ? base_name + 1 : source.rom_name;
+        strncpy(entry.name, base_name, ROM_PACK_NAME_SIZE - 1);
+
+        // Identical images are stored once
+        const bool duplicate = std::any_of(entries.begin(), entries.end(),
+            [&entry](const RomPackEntry &e) { return e.hash == entry.hash; });
+
+        if(duplicate) {
+            std::cout << "Skipping duplicate ROM " << source.rom_name << "\n";
+            continue;
+        }
+
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llX", (unsigned long long)entry.hash);
+        std::cout << "Adding ROM " << entry.name << " (hash " << hash << ")\n";
+
+        entries.push_back(entry);
+        images.push_back(std::move(image));
+    }
+
+    // Entries keep the given order, the hash index sorts them for find()
+    std::vector<uint32_t> hash_index(entries.size());
+    for(size_t i = 0; i < hash_index.size(); ++i) {
+        hash_index[i] = static_cast<uint32_t>(i);
+    }
+
+    std::sort(hash_index.begin(), hash_index.end(),
+        [&entries](uint32_t a, uint32_t b) { return entries[a].hash < entries[b].hash; });
+
+    // Lay out images after the entry table and hash index
+    uint32_t offset = sizeof(RomPackHeader) + entries.size() * (sizeof(RomPackEntry) + sizeof(uint32_t));
+
+    for(RomPackEntry &entry : entries) {
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    RomPackHeader header = {};
+    memcpy(header.magic, ROM_PACK_MAGIC, sizeof(ROM_PACK_MAGIC));
+    header.version = ROM_PACK_VERSION;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+
+    // Write pack file
+    FILE *pack = fopen(pack_name, "wb");
+    if(!pack) {
+        std::cerr << "ERROR: Failed to create ROM pack " << pack_name << "!\n";
+        return false;
+    }
+
+    bool write_ok = fwrite(&header, sizeof(header), 1, pack) == 1;
+
+    if(!entries.empty()) {
+        write_ok = write_ok && fwrite(entries.data(), sizeof(RomPackEntry), entries.size(), pack) == entries.size();
+        write_ok = write_ok && fwrite(hash_index.data(), sizeof(uint32_t), hash_index.size(), pack) == hash_index.size();
+    }
+
+    for(const std::vector<uint8_t> &image : images) {
+        write_ok = write_ok && fwrite(image.data(), image.size(), 1, pack) == 1;
+    }
+
+    fclose(pack);
+
+    if(!write_ok) {
+        std::cerr << "ERROR: Could not write ROM pack " << pack_name << "\n";
+        return false;
+    }
+
+    std::cout << "Succesfully built ROM pack " << pack_name << " (" << entries.size() << " ROMs)!\n";
+    return true;
+}
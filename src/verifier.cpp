@@ -0,0 +1,349 @@
+#include "../inc/verifier.hpp"
+#include "../inc/disassembler.hpp"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Stateless 64 bit mixer, so the input at any instruction can be replayed
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static const char *engineName(ExecutionEngine engine) {
+    switch(engine) {
+        case ENGINE_SWITCH: return "switch";
+        case ENGINE_TABLE:  return "table";
+    }
+
+    return "unknown";
+}
+
+Verifier::Verifier(const VerifierConfig &config) : m_config(config) {
+    if(m_config.check_interval == 0) {
+        m_config.check_interval = 1;
+    }
+
+    EmulatorConfig emu_config = {
+        64, 32,
+        0xFFFFFFFF,
+        0x00FFFFFF,
+        1,
+        nullptr,            // ROMs are loaded through reset()
+        true,               // Headless
+        m_config.seed,
+        m_config.reference,
+        m_config.instructions_per_frame,
+        0,                  // No run-ahead
+        true,               // Unthrottled
+        1,                  // No turbo
+        0,                  // No frame limit
+        m_config.quirks,
+        nullptr,            // No profile
+        nullptr,            // No trace
+        nullptr             // ROMs are selected by the caller
+    };
+
+    m_reference = std::make_unique<CHIP8>(emu_config);
+
+    emu_config.engine = m_config.candidate;
+    m_candidate = std::make_unique<CHIP8>(emu_config);
+}
+
+Fault Verifier::stepEngines(uint64_t instruction) {
+    if(m_config.input_interval != 0 && instruction % m_config.input_interval == 0) {
+        const uint64_t event = splitmix64(m_config.seed ^ instruction);
+        const uint8_t key = event & 0xF;
+        const bool pressed = (event >> 4) & 0x1;
+
+        m_reference->setKey(key, pressed);
+        m_candidate->setKey(key, pressed);
+    }
+
+    const Fault fault = m_reference->step();
+    m_candidate->step();
+
+    // Timers tick at the end of every emulated frame
+    if((instruction + 1) % m_reference->instructionsPerFrame() == 0) {
+        m_reference->tickTimers();
+        m_candidate->tickTimers();
+    }
+
+    return fault;
+}
+
+std::string Verifier::compareStates(const CHIP8Snapshot &a, const CHIP8Snapshot &b) {
+    char text[128];
+
+    if(a.fault.code != b.fault.code || a.fault.pc != b.fault.pc || a.fault.opcode != b.fault.opcode) {
+        snprintf(text, sizeof(text), "fault '%s' at 0x%03X != '%s' at 0x%03X",
+                 CHIP8::faultName(a.fault.code), a.fault.pc, CHIP8::faultName(b.fault.code), b.fault.pc);
+        return text;
+    }
+
+    if(a.pc != b.pc) {
+        snprintf(text, sizeof(text), "PC 0x%03X != 0x%03X", a.pc, b.pc);
+        return text;
+    }
+
+    if(a.index_register != b.index_register) {
+        snprintf(text, sizeof(text), "I 0x%03X != 0x%03X", a.index_register, b.index_register);
+        return text;
+    }
+
+    for(uint32_t i = 0; i < 16; ++i) {
+        if(a.registers[i] != b.registers[i]) {
+            snprintf(text, sizeof(text), "V%X 0x%02X != 0x%02X", i, a.registers[i], b.registers[i]);
+            return text;
+        }
+    }
+
+    if(a.stack_pointer != b.stack_pointer) {
+        snprintf(text, sizeof(text), "SP %u != %u", a.stack_pointer, b.stack_pointer);
+        return text;
+    }
+
+    for(uint32_t i = 0; i < 16; ++i) {
+        if(a.stack[i] != b.stack[i]) {
+            snprintf(text, sizeof(text), "stack[%u] 0x%03X != 0x%03X", i, a.stack[i], b.stack[i]);
+            return text;
+        }
+    }
+
+    if(a.delay_timer != b.delay_timer || a.sound_timer != b.sound_timer) {
+        snprintf(text, sizeof(text), "DT/ST %u/%u != %u/%u",
+                 a.delay_timer, a.sound_timer, b.delay_timer, b.sound_timer);
+        return text;
+    }
+
+    const uint64_t memory_a = fnv1a(a.memory, sizeof(a.memory));
+    const uint64_t memory_b = fnv1a(b.memory, sizeof(b.memory));
+
+    if(memory_a != memory_b) {
+        uint32_t address = 0;
+        while(a.memory[address] == b.memory[address]) {
+            ++address;
+        }
+
+        snprintf(text, sizeof(text), "memory hash %016llX != %016llX (first at 0x%03X)",
+                 (unsigned long long)memory_a, (unsigned long long)memory_b, address);
+        return text;
+    }
+
+    const uint64_t display_a = fnv1a(reinterpret_cast<const uint8_t*>(a.display), sizeof(a.display));
+    const uint64_t display_b = fnv1a(reinterpret_cast<const uint8_t*>(b.display), sizeof(b.display));
+
+    if(display_a != display_b) {
+        snprintf(text, sizeof(text), "display hash %016llX != %016llX",
+                 (unsigned long long)display_a, (unsigned long long)display_b);
+        return text;
+    }
+
+    if(memcmp(a.input_keys, b.input_keys, sizeof(a.input_keys)) != 0) {
+        return "input keys differ";
+    }
+
+    if(a.rand_gen != b.rand_gen) {
+        return "random engine state differs";
+    }
+
+    return "";
+}
+
+bool Verifier::findDivergence(uint64_t first, uint64_t last) {
+    // Rewind both engines to the last matching state and replay one instruction at a time
+    m_reference->loadSnapshot(m_reference_state);
+    m_candidate->loadSnapshot(m_candidate_state);
+
+    for(uint64_t i = first; i <= last; ++i) {
+        m_reference->saveSnapshot(m_reference_state);
+
+        const uint16_t pc = m_reference_state.pc;
+        const uint16_t opcode = (m_reference_state.memory[pc & 0xFFF] << 8) | m_reference_state.memory[(pc + 1) & 0xFFF];
+
+        stepEngines(i);
+
+        m_reference->saveSnapshot(m_reference_check);
+        m_candidate->saveSnapshot(m_candidate_check);
+
+        const std::string difference = compareStates(m_reference_check, m_candidate_check);
+
+        if(!difference.empty()) {
+            char location[64];
+            snprintf(location, sizeof(location), "instruction %llu at PC 0x%03X: %04X  ",
+                     (unsigned long long)i, pc, opcode);
+
+            std::cerr << "DIVERGENCE: " << location << disassemble(opcode) << "\n"
+                      << "  " << engineName(m_config.reference) << " vs " << engineName(m_config.candidate)
+                      << ": " << difference << "\n";
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Verifier::verifyROM(const RomImage &rom) {
+    std::cout << "Verifying " << (rom.name ? rom.name : "ROM") << " (" << engineName(m_config.reference)
+              << " vs " << engineName(m_config.candidate) << ")...\n";
+
+    if(!m_reference->reset(rom) || !m_candidate->reset(rom)) {
+        return false;
+    }
+
+    // Start both engines from the exact same state, random engine included
+    m_reference->saveSnapshot(m_reference_state);
+    m_candidate->loadSnapshot(m_reference_state);
+    m_candidate->saveSnapshot(m_candidate_state);
+
+    uint64_t last_check = 0;
+
+    for(uint64_t i = 0; i < m_config.instructions; ++i) {
+        const Fault fault = stepEngines(i);
+
+        // A faulting ROM is compared once more and then stops
+        const bool last = i + 1 == m_config.instructions || fault != FAULT_NONE;
+
+        if((i + 1) % m_config.check_interval != 0 && !last) {
+            continue;
+        }
+
+        m_reference->saveSnapshot(m_reference_check);
+        m_candidate->saveSnapshot(m_candidate_check);
+
+        const std::string difference = compareStates(m_reference_check, m_candidate_check);
+
+        if(!difference.empty()) {
+            if(!findDivergence(last_check, i)) {
+                std::cerr << "DIVERGENCE: between instructions " << last_check << " and " << i
+                          << ", not reproduced by the replay\n"
+                          << "  " << engineName(m_config.reference) << " vs " << engineName(m_config.candidate)
+                          << ": " << difference << "\n";
+            }
+            return false;
+        }
+
+        if(fault != FAULT_NONE) {
+            const FaultInfo &info = m_reference->fault();
+            char location[64];
+            snprintf(location, sizeof(location), " at PC 0x%03X: %04X  ", info.pc, info.opcode);
+
+            std::cout << "OK: both engines faulted after " << i + 1 << " instructions with "
+                      << CHIP8::faultName(fault) << location << disassemble(info.opcode) << "\n";
+            return true;
+        }
+
+        m_reference_state = m_reference_check;
+        m_candidate_state = m_candidate_check;
+        last_check = i + 1;
+    }
+
+    std::cout << "OK: " << m_config.instructions << " instructions matched\n";
+    return true;
+}
+
+bool Verifier::verifyFile(const char *file_name) {
+    if(RomPack::isPackFile(file_name)) {
+        RomPack pack;
+        if(!pack.open(file_name)) {
+            return false;
+        }
+
+        bool all_matched = true;
+        for(size_t i = 0; i < pack.size(); ++i) {
+            all_matched = verifyROM(pack.at(i)) && all_matched;
+        }
+
+        return all_matched;
+    }
+
+    FILE *rom = fopen(file_name, "rb");
+    if(!rom) {
+        std::cerr << "ERROR: Failed to open ROM file " << file_name << "!\n";
+        return false;
+    }
+
+    fseek(rom, 0, SEEK_END);
+    std::vector<uint8_t> image(ftell(rom));
+    rewind(rom);
+
+    const bool read_ok = image.empty() || fread(image.data(), image.size(), 1, rom) == 1;
+    fclose(rom);
+
+    if(!read_ok) {
+        std::cerr << "ERROR: Could not read ROM file " << file_name << "\n";
+        return false;
+    }
+
+    const RomImage rom_image = {
+        image.data(),
+        static_cast<uint32_t>(image.size()),
+        fnv1a(image.data(), image.size()),
+        0,
+        0,
+        file_name
+    };
+
+    return verifyROM(rom_image);
+}
+
+bool Verifier::fuzz(uint64_t cases) {
+    std::cout << "Fuzzing " << cases << " random instructions (" << engineName(m_config.reference)
+              << " vs " << engineName(m_config.candidate) << ")...\n";
+
+    std::mt19937_64 rng(m_config.seed);
+    CHIP8Snapshot &state = m_reference_state;
+
+    for(uint64_t c = 0; c < cases; ++c) {
+        // Random machine state
+        for(uint8_t &reg : state.registers) reg = rng();
+        for(uint8_t &byte : state.memory) byte = rng();
+        for(uint16_t &address : state.stack) address = rng() & 0x0FFF;
+        for(uint8_t &key : state.input_keys) key = rng() & 0x1;
+        for(uint32_t &pixel : state.display) pixel = rng() & 0x1;
+
+        state.index_register = rng() & MEMORY_MASK;
+        state.pc = rng() & MEMORY_MASK;
+        state.stack_pointer = rng() % 17;
+        state.delay_timer = rng();
+        state.sound_timer = rng();
+        state.beep = false;
+        state.rand_gen.seed(static_cast<uint32_t>(rng()));
+        state.fault = {};
+
+        // Random opcode at PC, unsupported opcodes must fault identically
+        const uint16_t opcode = rng();
+
+        state.memory[state.pc] = opcode >> 8;
+        state.memory[(state.pc + 1) & MEMORY_MASK] = opcode & 0xFF;
+
+        m_reference->loadSnapshot(state);
+        m_candidate->loadSnapshot(state);
+
+        m_reference->step();
+        m_candidate->step();
+
+        m_reference->saveSnapshot(m_reference_check);
+        m_candidate->saveSnapshot(m_candidate_check);
+
+        const std::string difference = compareStates(m_reference_check, m_candidate_check);
+
+        if(!difference.empty()) {
+            char location[64];
+            snprintf(location, sizeof(location), "case %llu at PC 0x%03X: %04X  ",
+                     (unsigned long long)c, state.pc, opcode);
+
+            std::cerr << "DIVERGENCE: " << location << disassemble(opcode) << "\n"
+                      << "  " << engineName(m_config.reference) << " vs " << engineName(m_config.candidate)
+                      << ": " << difference << "\n";
+            return false;
+        }
+    }
+
+    std::cout << "OK: " << cases << " random instructions matched\n";
+    return true;
+}